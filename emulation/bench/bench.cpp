@@ -0,0 +1,326 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "auroraemu.hpp"
+#include "hlslib/xilinx/Stream.h"
+
+typedef std::chrono::steady_clock bench_clock;
+typedef hlslib::Stream<data_stream_t> stream_t;
+
+struct Options {
+    std::vector<std::string> transports = {"ipc",    "tcp",    "shm",
+                                           "switch", "direct", "runtime"};
+    std::vector<std::string> topologies = {"loopback", "pair", "ring",
+                                           "pairs"};
+    std::vector<size_t> message_beats = {1, 8, 64};
+    size_t beats = 1 << 16;
+    size_t iterations = 1000;
+    size_t cores = 4;
+    size_t stream_depth = DEFAULT_RX_FIFO_DEPTH;
+    int port = 20000;
+};
+
+/**
+ * Emulated cores of one topology. Core i sends to core next[i]. Cores that
+ * are listed in initiators start the round trips of the latency
+ * measurement, all other cores forward the received data
+ */
+struct Topology {
+    std::vector<size_t> next;
+    std::vector<size_t> initiators;
+
+    std::vector<std::unique_ptr<stream_t>> in;
+    std::vector<std::unique_ptr<stream_t>> out;
+    std::vector<std::unique_ptr<AuroraEmu>> emus;
+    std::unique_ptr<AuroraEmuSwitch> emu_switch;
+    // declared before the cores, so it outlives them
+    std::unique_ptr<AuroraEmuRuntime> runtime;
+    std::vector<std::unique_ptr<AuroraEmuCore>> cores;
+
+    size_t size() { return next.size(); }
+};
+
+static std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static void usage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+              << "  -t transports  ipc,tcp,shm,switch,direct,runtime" << std::endl
+              << "  -g topologies  loopback,pair,ring,pairs" << std::endl
+              << "  -s sizes       message sizes in beats, e.g. 1,8,64"
+              << std::endl
+              << "  -b beats       beats sent by every core for the "
+                 "throughput"
+              << std::endl
+              << "  -i iterations  round trips for the latency" << std::endl
+              << "  -n cores       cores in the ring and pairs topologies"
+              << std::endl
+              << "  -d depth       depth of the AXI streams in beats"
+              << std::endl
+              << "  -p port        first port used by tcp and switch"
+              << std::endl;
+}
+
+static void create_topology(Topology &t, const std::string &topology,
+                            size_t cores, size_t stream_depth) {
+    if (topology == "loopback") {
+        t.next = {0};
+        t.initiators = {0};
+    } else if (topology == "pair") {
+        t.next = {1, 0};
+        t.initiators = {0};
+    } else if (topology == "ring") {
+        for (size_t i = 0; i < cores; i++) {
+            t.next.push_back((i + 1) % cores);
+        }
+        t.initiators = {0};
+    } else if (topology == "pairs") {
+        if (cores % 2 != 0) {
+            throw std::invalid_argument("pairs needs an even number of cores");
+        }
+        for (size_t i = 0; i < cores; i++) {
+            t.next.push_back(i ^ 1);
+            if (i % 2 == 0) {
+                t.initiators.push_back(i);
+            }
+        }
+    } else {
+        throw std::invalid_argument("Unsupported topology " + topology);
+    }
+    for (size_t i = 0; i < t.size(); i++) {
+        t.in.emplace_back(
+            new stream_t("in" + std::to_string(i), stream_depth));
+        t.out.emplace_back(
+            new stream_t("out" + std::to_string(i), stream_depth));
+    }
+}
+
+static void connect_cores(Topology &t, const std::string &transport,
+                          size_t batch_size, int port) {
+    if (transport == "switch" || transport == "direct") {
+        t.emu_switch.reset(new AuroraEmuSwitch("127.0.0.1", port));
+        for (size_t i = 0; i < t.size(); i++) {
+            t.cores.emplace_back(new AuroraEmuCore(
+                "127.0.0.1", port, "bench" + std::to_string(i),
+                "bench" + std::to_string(t.next[i]), *t.in[i], *t.out[i],
+                batch_size, DEFAULT_FLUSH_TIMEOUT, DEFAULT_RX_FIFO_DEPTH,
+                DEFAULT_RX_FIFO_PROG_FULL, DEFAULT_RX_FIFO_PROG_EMPTY,
+                AuroraEmuLinkModel::unlimited(), false,
+                transport == "direct"));
+        }
+        return;
+    }
+    if (transport == "runtime") {
+        t.emu_switch.reset(new AuroraEmuSwitch("127.0.0.1", port));
+        t.runtime.reset(new AuroraEmuRuntime());
+        for (size_t i = 0; i < t.size(); i++) {
+            t.cores.emplace_back(new AuroraEmuCore(
+                *t.runtime, "127.0.0.1", port, "bench" + std::to_string(i),
+                "bench" + std::to_string(t.next[i]), *t.in[i], *t.out[i],
+                batch_size));
+        }
+        return;
+    }
+    for (size_t i = 0; i < t.size(); i++) {
+        std::string name = transport == "tcp"
+                               ? "127.0.0.1:" + std::to_string(port + i)
+                               : "bench" + std::to_string(i);
+        t.emus.emplace_back(new AuroraEmu(transport, name, *t.in[i],
+                                          *t.out[i], batch_size));
+    }
+    for (size_t i = 0; i < t.size(); i++) {
+        t.emus[t.next[i]]->connect(t.emus[i]->get_address());
+    }
+    for (auto &emu : t.emus) {
+        if (!emu->wait_until_connected()) {
+            throw std::runtime_error("Could not connect " +
+                                     emu->get_address());
+        }
+    }
+}
+
+/**
+ * Every core sends beats to its neighbor and receives the same number of
+ * beats. Returns the aggregate throughput of all cores in Gbit/s
+ */
+static double measure_throughput(Topology &t, size_t beats) {
+    std::vector<std::thread> threads;
+    bench_clock::time_point start = bench_clock::now();
+    for (size_t i = 0; i < t.size(); i++) {
+        threads.emplace_back([&t, i, beats] {
+            data_stream_t data;
+            for (size_t j = 0; j < beats; j++) {
+                data.data = j;
+                t.in[i]->write(data);
+            }
+        });
+        threads.emplace_back([&t, i, beats] {
+            for (size_t j = 0; j < beats; j++) {
+                t.out[i]->read();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> seconds = bench_clock::now() - start;
+    double bits = 8.0 * sizeof(ap_uint<512>) * beats * t.size();
+    return bits / seconds.count() / 1e9;
+}
+
+/**
+ * The initiators send a message of message_beats beats, which is forwarded
+ * along the topology until it arrives back at the initiator. Returns the
+ * round trip times of all initiators in microseconds
+ */
+static std::vector<double> measure_latency(Topology &t, size_t message_beats,
+                                           size_t iterations) {
+    std::vector<std::vector<double>> rtts(t.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < t.size(); i++) {
+        bool initiator = std::find(t.initiators.begin(), t.initiators.end(),
+                                   i) != t.initiators.end();
+        if (initiator) {
+            threads.emplace_back([&t, &rtts, i, message_beats, iterations] {
+                data_stream_t data;
+                for (size_t j = 0; j < iterations; j++) {
+                    bench_clock::time_point start = bench_clock::now();
+                    for (size_t k = 0; k < message_beats; k++) {
+                        data.data = k;
+                        t.in[i]->write(data);
+                    }
+                    for (size_t k = 0; k < message_beats; k++) {
+                        t.out[i]->read();
+                    }
+                    std::chrono::duration<double, std::micro> rtt =
+                        bench_clock::now() - start;
+                    rtts[i].push_back(rtt.count());
+                }
+            });
+        } else {
+            threads.emplace_back([&t, i, message_beats, iterations] {
+                for (size_t j = 0; j < iterations * message_beats; j++) {
+                    t.in[i]->write(t.out[i]->read());
+                }
+            });
+        }
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::vector<double> all;
+    for (auto &r : rtts) {
+        all.insert(all.end(), r.begin(), r.end());
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:g:s:b:i:n:d:p:h")) != -1) {
+        switch (opt) {
+            case 't':
+                options.transports = split(optarg);
+                break;
+            case 'g':
+                options.topologies = split(optarg);
+                break;
+            case 's':
+                options.message_beats.clear();
+                for (auto &size : split(optarg)) {
+                    options.message_beats.push_back(std::stoul(size));
+                }
+                break;
+            case 'b':
+                options.beats = std::stoul(optarg);
+                break;
+            case 'i':
+                options.iterations = std::stoul(optarg);
+                break;
+            case 'n':
+                options.cores = std::stoul(optarg);
+                break;
+            case 'd':
+                options.stream_depth = std::stoul(optarg);
+                break;
+            case 'p':
+                options.port = std::stoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // one line per measurement, so results can be compared across releases
+    std::cout << "transport,topology,cores,message_beats,message_bytes,"
+                 "throughput_gbps,rtt_min_us,rtt_p50_us,rtt_p90_us,"
+                 "rtt_p99_us,rtt_max_us"
+              << std::endl;
+    for (auto &transport : options.transports) {
+        for (auto &topology : options.topologies) {
+            for (size_t message_beats : options.message_beats) {
+                Topology t;
+                create_topology(t, topology, options.cores,
+                                options.stream_depth);
+                connect_cores(t, transport, message_beats, options.port);
+                double throughput = measure_throughput(t, options.beats);
+                std::vector<double> rtts =
+                    measure_latency(t, message_beats, options.iterations);
+                std::cout << transport << "," << topology << "," << t.size()
+                          << "," << message_beats << ","
+                          << message_beats * sizeof(ap_uint<512>) << ","
+                          << std::fixed << std::setprecision(3) << throughput
+                          << "," << percentile(rtts, 0) << ","
+                          << percentile(rtts, 50) << ","
+                          << percentile(rtts, 90) << ","
+                          << percentile(rtts, 99) << ","
+                          << percentile(rtts, 100) << std::endl;
+            }
+        }
+    }
+    return 0;
+}
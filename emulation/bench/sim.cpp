@@ -0,0 +1,114 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "auroraemu_sim.hpp"
+
+static void usage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+              << "  -b beats       beats sent over the link" << std::endl
+              << "  -r rate        line rate in Gbit/s" << std::endl
+              << "  -l latency     propagation latency in ns" << std::endl
+              << "  -o overhead    frame overhead in bytes" << std::endl
+              << "  -F beats       beats per frame" << std::endl
+              << "  -d depth       RX FIFO depth in beats" << std::endl
+              << "  -f prog_full   RX FIFO prog_full in beats" << std::endl
+              << "  -e prog_empty  RX FIFO prog_empty in beats" << std::endl
+              << "  -n reaction    NFC reaction time in ns" << std::endl
+              << "  -c rate        consumer rate in Gbit/s, 0 is unlimited"
+              << std::endl
+              << "  -w delay       consumer start delay in ns" << std::endl
+              << "  -s interval    FIFO sample interval in ns" << std::endl
+              << "  -O file        write the FIFO fill levels as CSV"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    AuroraEmuSimConfig config;
+    double line_rate_gbps = DEFAULT_LINE_RATE_GBPS;
+    uint64_t latency_ns = 0;
+    size_t frame_overhead_bytes = 0;
+    std::string occupancy_file;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:r:l:o:F:d:f:e:n:c:w:s:O:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                config.beats = std::stoull(optarg);
+                break;
+            case 'r':
+                line_rate_gbps = std::stod(optarg);
+                break;
+            case 'l':
+                latency_ns = std::stoull(optarg);
+                break;
+            case 'o':
+                frame_overhead_bytes = std::stoul(optarg);
+                break;
+            case 'F':
+                config.frame_beats = std::stoul(optarg);
+                break;
+            case 'd':
+                config.rx_fifo_depth = std::stoul(optarg);
+                break;
+            case 'f':
+                config.rx_fifo_prog_full = std::stoul(optarg);
+                break;
+            case 'e':
+                config.rx_fifo_prog_empty = std::stoul(optarg);
+                break;
+            case 'n':
+                config.nfc_reaction_ns = std::stoull(optarg);
+                break;
+            case 'c':
+                config.consumer_rate_gbps = std::stod(optarg);
+                break;
+            case 'w':
+                config.consumer_delay_ns = std::stoull(optarg);
+                break;
+            case 's':
+                config.sample_interval_ns = std::stoull(optarg);
+                break;
+            case 'O':
+                occupancy_file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    AuroraEmuLinkModel link(line_rate_gbps, latency_ns, frame_overhead_bytes);
+    AuroraEmuSimResult result = AuroraEmuSim(link, config).run();
+    std::cout << "duration_us,throughput_gbps,xoff_count,xon_count,"
+                 "overflow_beats,max_fill_level,tx_paused_us"
+              << std::endl
+              << std::fixed << std::setprecision(3)
+              << result.duration_ns / 1000 << "," << result.throughput_gbps
+              << "," << result.xoff_count << "," << result.xon_count << ","
+              << result.overflow_beats << "," << result.max_fill_level << ","
+              << result.tx_paused_ns / 1000 << std::endl;
+    if (!occupancy_file.empty()) {
+        std::ofstream out(occupancy_file);
+        result.write_occupancy_csv(out);
+    }
+    return 0;
+}
@@ -15,8 +15,14 @@
  */
 
 #ifndef SYNTHESIS
+#ifdef AURORA_EMU_FIBERS
+// kernels are executed as fibers and suspend while waiting for a stream
+#include "auroraemu_fiber.hpp"
+#define STREAM AuroraEmuStream
+#else
 #include "hlslib/xilinx/Stream.h"
 #define STREAM hlslib::Stream
+#endif
 #else
 #include "hls_streams.h"
 #define STREAM hls::stream
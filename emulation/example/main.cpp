@@ -23,15 +23,23 @@
 
 int main() {
     // create AXI input and output axi streams for the aurora cores
-    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
-        out2("out2");
+    STREAM<data_stream_t> in1("in1"), out1("out1"), in2("in2"), out2("out2");
     // Create an aurora switch
     AuroraEmuSwitch s("127.0.0.1", 20000);
+#ifdef AURORA_EMU_FIBERS
+    // a single worker thread executes the cores and both kernels
+    AuroraEmuRuntime runtime(1);
+    AuroraEmuCore a1(runtime, "127.0.0.1", 20000, "a1", "a2",
+                     in1.get_stream(), out1.get_stream());
+    AuroraEmuCore a2(runtime, "127.0.0.1", 20000, "a2", "a1",
+                     in2.get_stream(), out2.get_stream());
+#else
     // create emulated aurora cores
     // connect cores to switch and set own identifier and identifier of
     // remote core
     AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
     AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+#endif
 
     // create some input data
     float data_in[64];
@@ -41,12 +49,22 @@ int main() {
         data_out[i] = 0;
     }
 
+#ifdef AURORA_EMU_FIBERS
+    // start both kernels as fibers on the runtime
+    AuroraEmuFiber remote_kernel(
+        runtime, [&] { remote_vadd(data_in, 64, out2, in2); });
+    AuroraEmuFiber local_kernel(
+        runtime, [&] { collector(data_in, data_out, 64, out1, in1); });
+    local_kernel.join();
+    remote_kernel.join();
+#else
     // Start the vadd kernel on the remote FPGA
     std::thread remote_kernel(remote_vadd, data_in, 64, std::ref(out2),
                               std::ref(in2));
     // start the collector kernel locally
     collector(data_in, data_out, 64, out1, in1);
     remote_kernel.join();
+#endif
 
     // validate result and print absolute error
     float error = 0.0;
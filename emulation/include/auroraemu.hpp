@@ -13,20 +13,335 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#pragma once
+
 #include <ap_axi_sdata.h>
 #include <ap_int.h>
 #include <hlslib/xilinx/Stream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 #include <zmq.hpp>
 
+#include "auroraemu_link.hpp"
+#include "auroraemu_pool.hpp"
+#include "auroraemu_registers.hpp"
+#include "auroraemu_ring.hpp"
+#include "auroraemu_runtime.hpp"
+#include "auroraemu_stats.hpp"
+#include "auroraemu_trace.hpp"
+
 typedef ap_axiu<512, 0, 0, 0> data_stream_t;
 
-const int RECV_POLL_INTERVAL = 100;
+/**
+ * Width of the AXI stream type T that is passed between the user kernels and
+ * the emulator. Only the bytes of the data signal of a beat are sent, so
+ * streams with 256 bit wide beats move 32 bytes per beat. Can be specialized
+ * for other stream types with a data signal of type ap_uint
+ */
+template <typename T>
+struct AuroraEmuStreamTraits;
+
+template <int D, int U, int TI, int TD>
+struct AuroraEmuStreamTraits<ap_axiu<D, U, TI, TD>> {
+    static_assert(D % 8 == 0 && D <= 512,
+                  "Data width has to be a multiple of 8 of at most 512 bits");
+    enum { width = D, bytes = D / 8 };
+};
+
+// time in milliseconds after which blocked sends check for termination
+const int RETRY_INTERVAL = 100;
+
+// maximum number of beats that are packed into a single ZMQ message
+const size_t DEFAULT_BATCH_SIZE = 64;
+// time in microseconds to wait for further beats before a batch is sent.
+// 0 sends the batch as soon as the TX stream runs empty
+const int DEFAULT_FLUSH_TIMEOUT = 0;
+
+// RX FIFO configuration of the default hardware build in beats
+// (RX_FIFO_DEPTH, RX_FIFO_PROG_FULL and RX_FIFO_PROG_EMPTY in the Makefile)
+const size_t DEFAULT_RX_FIFO_DEPTH = 1024;
+const size_t DEFAULT_RX_FIFO_PROG_FULL = 512;
+const size_t DEFAULT_RX_FIFO_PROG_EMPTY = 128;
 
-class AuroraEmu {
+// number of threads that route messages in the switch
+const size_t DEFAULT_SWITCH_SHARDS = 4;
+// time in milliseconds to wait for the switch or the remote emulator
+// to answer
+const int DEFAULT_CONNECT_TIMEOUT = 10000;
+// longest sleep in microseconds between two checks of an empty TX stream.
+// hlslib streams can not be waited on with a timeout, so the TX threads
+// poll them. Short sleeps keep the latency of the first beat after an
+// idle period low, at the cost of frequent wake-ups of idle cores
+const unsigned TX_POLL_INTERVAL = 16;
+
+// control codes of the emulated native flow control
+const uint8_t NFC_XON = 0;
+const uint8_t NFC_XOFF = 1;
+
+// sideband signals of a beat. Transferred after the data of a batch if
+// framing is enabled
+struct AuroraEmuSideband {
+    uint64_t keep;
+    uint64_t last;
+};
+
+/**
+ * Read a beat from a TX stream. Polls the stream with a backoff of at most
+ * TX_POLL_INTERVAL while it is empty, so the forwarding threads can be
+ * stopped without writing into the stream of the user.
+ *
+ * Returns false if running was cleared before a beat arrived
+ */
+template <typename T>
+inline bool read_beat(hlslib::Stream<T> &stream, T &beat,
+                      const std::atomic<bool> &running) {
+    AuroraEmuBackoff backoff(TX_POLL_INTERVAL);
+    while (stream.empty()) {
+        if (!running) {
+            return false;
+        }
+        backoff.wait();
+    }
+    beat = stream.read();
+    return true;
+}
+
+/**
+ * Read a batch of beats from a TX stream into buffer. Waits for the first
+ * beat like read_beat(). Reading stops if batch_size beats were read or if
+ * the stream stays empty until flush_timeout_us microseconds after the
+ * first beat.
+ *
+ * Returns the number of beats in the buffer, 0 if running was cleared
+ */
+template <typename T>
+inline size_t read_batch(hlslib::Stream<T> &stream, std::vector<T> &buffer,
+                         size_t batch_size, int flush_timeout_us,
+                         const std::atomic<bool> &running) {
+    buffer.clear();
+    T first;
+    if (!read_beat(stream, first, running)) {
+        return 0;
+    }
+    buffer.push_back(first);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(flush_timeout_us);
+    // waiting for further beats backs off, so idle emulators with a flush
+    // timeout do not occupy a core
+    AuroraEmuBackoff backoff(TX_POLL_INTERVAL);
+    while (buffer.size() < batch_size) {
+        if (!stream.empty()) {
+            buffer.push_back(stream.read());
+            backoff.reset();
+        } else if (std::chrono::steady_clock::now() < deadline) {
+            backoff.wait(deadline);
+        } else {
+            break;
+        }
+    }
+    return buffer.size();
+}
+
+/**
+ * Copy the data of a beat into its wire format
+ */
+template <typename T>
+inline void store_beat(const T &beat, void *wire) {
+    std::memcpy(wire, &beat.data, AuroraEmuStreamTraits<T>::bytes);
+}
+
+/**
+ * Copy the data of a beat from its wire format
+ */
+template <typename T>
+inline void load_beat(T &beat, const void *wire) {
+    std::memcpy(&beat.data, wire, AuroraEmuStreamTraits<T>::bytes);
+}
+
+/**
+ * Pack a batch of beats into the payload of a message. With framing, the
+ * keep and last signals of all beats follow the data. The payload ends with
+ * the timestamp_ns() at which it was packed, which is used to measure the
+ * transit latency.
+ *
+ * Returns the number of frames in the batch. Without framing, the whole
+ * batch counts as one frame
+ *
+ * pool: if given, the payload is written into a buffer of the pool that is
+ *       sent without copying it again
+ */
+template <typename T>
+inline size_t pack_batch(const std::vector<T> &batch, bool framing,
+                         zmq::message_t &msg,
+                         AuroraEmuBufferPool *pool = nullptr) {
+    const size_t bytes = AuroraEmuStreamTraits<T>::bytes;
+    size_t beats = batch.size();
+    size_t beat_size = bytes + (framing ? sizeof(AuroraEmuSideband) : 0);
+    size_t payload_size = beats * beat_size + sizeof(uint64_t);
+    char *data;
+    if (pool && payload_size <= pool->get_buffer_bytes()) {
+        data = pool->message(msg, payload_size);
+    } else {
+        msg.rebuild(payload_size);
+        data = static_cast<char *>(msg.data());
+    }
+    // the sideband is not aligned for narrow beats, so it is copied
+    char *sideband = data + beats * bytes;
+    size_t frames = framing ? 0 : 1;
+    for (size_t i = 0; i < beats; i++) {
+        store_beat(batch[i], data + i * bytes);
+        if (framing) {
+            AuroraEmuSideband s;
+            s.keep = batch[i].keep.to_uint64();
+            s.last = batch[i].last.to_uint();
+            std::memcpy(sideband + i * sizeof(s), &s, sizeof(s));
+            frames += s.last;
+        }
+    }
+    uint64_t sent = timestamp_ns();
+    std::memcpy(data + beats * beat_size, &sent, sizeof(sent));
+    return frames;
+}
+
+/**
+ * Call f for every beat in the wire format of pack_batch() without the
+ * timestamp, which is also used by the shm ring
+ */
+template <typename T, typename F>
+inline void unpack_beats(const void *payload, size_t beats, bool framing,
+                         F f) {
+    const size_t beat_bytes = AuroraEmuStreamTraits<T>::bytes;
+    const char *data = static_cast<const char *>(payload);
+    const char *sideband = data + beats * beat_bytes;
+    for (size_t i = 0; i < beats; i++) {
+        T beat;
+        load_beat(beat, data + i * beat_bytes);
+        if (framing) {
+            AuroraEmuSideband s;
+            std::memcpy(&s, sideband + i * sizeof(s), sizeof(s));
+            beat.keep = s.keep;
+            beat.last = s.last;
+        }
+        f(beat);
+    }
+}
+
+/**
+ * Number of beats in a payload that was packed with pack_batch()
+ */
+template <typename T>
+inline size_t batch_beats(size_t bytes, bool framing) {
+    size_t beat_size = AuroraEmuStreamTraits<T>::bytes +
+                       (framing ? sizeof(AuroraEmuSideband) : 0);
+    return (bytes - sizeof(uint64_t)) / beat_size;
+}
+
+/**
+ * Time at which a payload was packed with pack_batch()
+ */
+inline uint64_t batch_timestamp(const void *payload, size_t bytes) {
+    uint64_t sent;
+    std::memcpy(&sent,
+                static_cast<const char *>(payload) + bytes - sizeof(sent),
+                sizeof(sent));
+    return sent;
+}
+
+/**
+ * Call f for every beat of a payload that was packed with pack_batch().
+ * Returns the number of beats
+ */
+template <typename T, typename F>
+inline size_t unpack_batch(const void *payload, size_t bytes, bool framing,
+                           F f) {
+    size_t beats = batch_beats<T>(bytes, framing);
+    unpack_beats<T>(payload, beats, framing, f);
+    return beats;
+}
+
+/**
+ * Write the beats of a recorded trace into the RX stream of a user kernel,
+ * e.g. to benchmark a consumer kernel in isolation against real traffic.
+ * Blocks until the whole trace was written
+ *
+ * trace: trace with the beat width of T
+ * remote_to_user: stream that is read by the user kernel
+ * speedup: 1 keeps the original time between the batches, larger values
+ *          accelerate the replay. 0 writes the beats as fast as the stream
+ *          allows
+ * destination: only replay the batches received by the emulator with this
+ *              ID or address. All batches are replayed if empty
+ *
+ * Returns the number of beats that were written
+ */
+template <typename T>
+inline size_t replay_trace(AuroraEmuTraceReader &trace,
+                           hlslib::Stream<T> &remote_to_user,
+                           double speedup = 1,
+                           const std::string &destination = "") {
+    if (trace.get_beat_bytes() != AuroraEmuStreamTraits<T>::bytes) {
+        throw std::invalid_argument(
+            "Beat width of the trace does not match the stream");
+    }
+    if (speedup < 0) {
+        throw std::invalid_argument("Speedup must not be negative");
+    }
+    bool framing = trace.has_framing();
+    size_t beat_size = AuroraEmuStreamTraits<T>::bytes +
+                       (framing ? sizeof(AuroraEmuSideband) : 0);
+    AuroraEmuTraceEntry entry;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t first = 0;
+    bool started = false;
+    size_t beats = 0;
+    while (trace.next(entry)) {
+        if (!destination.empty() && entry.destination != destination) {
+            continue;
+        }
+        if (!started) {
+            first = entry.time_ns;
+            started = true;
+        }
+        if (speedup > 0) {
+            std::this_thread::sleep_until(
+                start + std::chrono::nanoseconds(static_cast<int64_t>(
+                            (entry.time_ns - first) / speedup)));
+        }
+        size_t count = entry.payload.size() / beat_size;
+        unpack_beats<T>(entry.payload.data(), count, framing,
+                        [&remote_to_user](T &beat) {
+                            remote_to_user.write(beat);
+                        });
+        beats += count;
+    }
+    return beats;
+}
+
+/**
+ * Emulated Aurora core that is connected directly to another emulator.
+ * T is the type of the AXI streams of the user kernels
+ */
+template <typename T>
+class BasicAuroraEmu {
    private:
+    // bytes of a beat on the wire
+    enum { beat_bytes = AuroraEmuStreamTraits<T>::bytes };
+
     // ZMQ sockets used to exchange data between Aurora cores
     zmq::context_t ctx;
     zmq::socket_t sock_out;
@@ -40,13 +355,195 @@ class AuroraEmu {
     std::thread send_thread;
 
     // streams used to pass data to and from user kernels
-    hlslib::Stream<data_stream_t> &remote_to_user;
-    hlslib::Stream<data_stream_t> &user_to_remote;
+    hlslib::Stream<T> &remote_to_user;
+    hlslib::Stream<T> &user_to_remote;
 
     // id that is used to name the socket of the aurora emulator
     // or the network port
     std::string id;
     std::string protocol;
+    // address of the emulator that sends data to this emulator
+    std::string remote_address;
+
+    // cleared to terminate the TX thread
+    std::atomic<bool> running;
+
+    // batching of beats into ZMQ messages
+    size_t batch_size;
+    int flush_timeout_us;
+
+    // transfer keep and last of every beat
+    bool framing;
+
+    // shared memory rings used instead of the ZMQ sockets for the
+    // shm protocol
+    std::unique_ptr<AuroraEmuRing> ring_out;
+    std::unique_ptr<AuroraEmuRing> ring_in;
+
+    // timing model of the link. Received data is passed through the delay
+    // line by an additional thread if the link has a latency
+    AuroraEmuLinkModel link_model;
+    std::unique_ptr<AuroraEmuDelayLine> delay_line;
+    std::thread delay_thread;
+
+    // buffers of the sent batches, which are passed to ZMQ without copying
+    AuroraEmuBufferPool tx_pool;
+
+    // forwarded data, beats in the delay line and latency of received
+    // batches
+    AuroraEmuStats stats;
+
+    // records received batches if set
+    std::atomic<AuroraEmuTraceWriter *> trace;
+
+    // set when a receiver subscribed to the data of this emulator
+    bool connected;
+    std::mutex connected_mutex;
+    std::condition_variable connected_cv;
+
+    void set_connected() {
+        std::lock_guard<std::mutex> lock(connected_mutex);
+        connected = true;
+        connected_cv.notify_all();
+    }
+
+    // wait for the first subscription to sock_out, so no data is published
+    // before a receiver listens. Returns false if the emulator is destroyed
+    // before
+    bool wait_for_subscriber() {
+        zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
+        kill_listener.connect("inproc://kill_" + id);
+        kill_listener.set(zmq::sockopt::subscribe, "");
+        zmq::message_t msg;
+        zmq::pollitem_t items[] = {{sock_out, 0, ZMQ_POLLIN, 0},
+                                   {kill_listener, 0, ZMQ_POLLIN, 0}};
+        while (true) {
+            zmq::poll(&items[0], 2);
+            if (items[0].revents & ZMQ_POLLIN) {
+                // subscriptions start with 1, unsubscriptions with 0
+                if (sock_out.recv(msg, zmq::recv_flags::none) &&
+                    msg.size() > 0 && *static_cast<uint8_t *>(msg.data())) {
+                    set_connected();
+                    return true;
+                }
+            }
+            if (items[1].revents & ZMQ_POLLIN) {
+                return false;
+            }
+        }
+    }
+
+    // number of beats in a received payload. Data from the shm ring
+    // contains only beats, ZMQ messages were packed with pack_batch()
+    size_t payload_beats(size_t bytes) {
+        return ring_in ? bytes / beat_bytes : batch_beats<T>(bytes, framing);
+    }
+
+    // apply the error model and pass received beats to the user kernel
+    void deliver(const void *payload, size_t bytes) {
+        size_t beats = payload_beats(bytes);
+        if (!ring_in) {
+            uint64_t sent = batch_timestamp(payload, bytes);
+            uint64_t now = timestamp_ns();
+            stats.add_latency(now > sent ? now - sent : 0, beats);
+        }
+        stats.add_rx(beats, beats * beat_bytes);
+        if (delay_line) {
+            stats.add_queue_depth(-static_cast<int64_t>(beats));
+        }
+        unpack_beats<T>(payload, beats, framing, [this](T &beat) {
+            if (link_model.has_errors()) {
+                link_model.inject_errors(beat.data, !framing || beat.last);
+            }
+            remote_to_user.write(beat);
+        });
+    }
+
+    // append a received payload to the trace. The timestamp of ZMQ
+    // messages is not recorded
+    void record(const void *payload, size_t bytes) {
+        AuroraEmuTraceWriter *writer = trace.load(std::memory_order_acquire);
+        if (writer) {
+            writer->record(remote_address, get_address(), timestamp_ns(),
+                           payload,
+                           ring_in ? bytes : bytes - sizeof(uint64_t));
+        }
+    }
+
+    // hold a received payload back for the latency of the link
+    void delay(const void *payload, size_t bytes) {
+        stats.add_queue_depth(payload_beats(bytes));
+        delay_line->push(payload, bytes);
+    }
+
+    void forward_from_delay_line() {
+        std::vector<char> payload;
+        while (delay_line->pop(payload)) {
+            deliver(payload.data(), payload.size());
+        }
+    }
+
+    static std::string ring_name(std::string address) {
+        return "/auroraemu_" + address.substr(address.find("://") + 3);
+    }
+
+    void forward_from_remote_shm() {
+        AuroraEmuBackoff backoff;
+        while (running) {
+            size_t count;
+            const char *beats = ring_in->peek(count);
+            if (count == 0) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            // copy beats directly from the ring into the user stream and
+            // release them in chunks, so the producer can continue early
+            if (count > DEFAULT_BATCH_SIZE) {
+                count = DEFAULT_BATCH_SIZE;
+            }
+            record(beats, count * beat_bytes);
+            if (delay_line) {
+                delay(beats, count * beat_bytes);
+            } else {
+                deliver(beats, count * beat_bytes);
+            }
+            ring_in->release(count);
+        }
+    }
+
+    void forward_from_user_shm() {
+        AuroraEmuBackoff backoff;
+        while (true) {
+            // wait until data arrives or the destructor stops the thread
+            T data;
+            if (!read_beat(user_to_remote, data, running)) {
+                return;
+            }
+            // wait for free space in the ring, which is only the case if
+            // the remote side does not keep up
+            size_t count;
+            char *slots = ring_out->claim(count);
+            while (count == 0) {
+                backoff.wait();
+                if (!running) {
+                    return;
+                }
+                slots = ring_out->claim(count);
+            }
+            backoff.reset();
+            // write all available beats directly into the ring
+            store_beat(data, slots);
+            size_t beats = 1;
+            while (beats < count && !user_to_remote.empty()) {
+                store_beat(user_to_remote.read(), slots + beats * beat_bytes);
+                beats++;
+            }
+            link_model.pace(beats * beat_bytes);
+            stats.add_tx(beats, beats * beat_bytes);
+            ring_out->publish(beats);
+        }
+    }
 
     void forward_from_remote() {
         zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
@@ -58,11 +555,14 @@ class AuroraEmu {
                                    {kill_listener, 0, ZMQ_POLLIN, 0}};
         while (true) {
             zmq::poll(&items[0], 2);
-            if (items[0].revents & ZMQ_POLLIN) {
-                auto result = sock_in.recv(msg, zmq::recv_flags::none);
-                data_stream_t data;
-                data.data = *static_cast<ap_uint<512> *>(msg.data());
-                remote_to_user.write(data);
+            if ((items[0].revents & ZMQ_POLLIN) &&
+                sock_in.recv(msg, zmq::recv_flags::none)) {
+                record(msg.data(), msg.size());
+                if (delay_line) {
+                    delay(msg.data(), msg.size());
+                } else {
+                    deliver(msg.data(), msg.size());
+                }
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
@@ -71,120 +571,430 @@ class AuroraEmu {
     }
 
     void forward_from_user() {
-        zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
-        kill_listener.connect("inproc://kill_" + id);
-        kill_listener.set(zmq::sockopt::subscribe, "");
+        if (!wait_for_subscriber()) {
+            return;
+        }
+        std::vector<T> batch;
+        batch.reserve(batch_size);
+        zmq::message_t msg;
         while (true) {
-            // check if stream is empty. If so, sleep a bit to reduce CPU load
-            while (user_to_remote.empty()) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(RECV_POLL_INTERVAL));
-                // check for kill signals in between
-                zmq::message_t m;
-                if (kill_listener.recv(m, zmq::recv_flags::dontwait)
-                        .has_value()) {
+            // wait until data arrives or the destructor stops the thread,
+            // then forward a batch of incoming data to the remote core
+            size_t beats = read_batch(user_to_remote, batch, batch_size,
+                                      flush_timeout_us, running);
+            if (!running) {
+                return;
+            }
+            size_t frames = pack_batch(batch, framing, msg, &tx_pool);
+            link_model.pace(beats * beat_bytes, frames);
+            // counted before sending, so the statistics of the receiver
+            // never show more data than the statistics of the sender
+            stats.add_tx(beats, beats * beat_bytes);
+            // the send blocks while the receiver does not keep up. Retry
+            // until it succeeds, so the destructor can still stop the thread
+            while (!sock_out.send(msg, zmq::send_flags::none)) {
+                if (!running) {
                     return;
                 }
             }
-            // forward incoming data to user kernel
-            ap_uint<512> data = user_to_remote.read().data;
-            zmq::message_t msg(static_cast<void *>(&data),
-                               sizeof(ap_uint<512>));
-            sock_out.send(msg, zmq::send_flags::none);
         }
     }
 
    public:
-    AuroraEmu(std::string host_address, int port,
-              hlslib::Stream<data_stream_t> &user_to_remote,
-              hlslib::Stream<data_stream_t> &remote_to_user)
+    /**
+     * Construct a new Aurora emulator
+     *
+     * protocol: transport used to connect the emulators. "tcp" and "ipc"
+     *           use ZMQ sockets. "shm" uses a lock-free ring buffer in
+     *           shared memory and can only connect emulators on the same
+     *           host
+     * name: address of the emulator without protocol. host:port for tcp,
+     *       name of the pipe for ipc or of the shared memory object for shm.
+     *       Must not contain slashes for shm
+     * user_to_remote: AXI stream to pass data into the aurora core
+     * remote_to_user: AXI stream to read data from the aurora core
+     * batch_size: maximum number of beats sent in a single message
+     * flush_timeout_us: time in microseconds to wait for further beats
+     *                   before an incomplete batch is sent
+     * ring_depth: number of beats buffered by the shm ring
+     * link_model: line rate, latency and error rates of the emulated link.
+     *             By default, data is forwarded as fast as the transport
+     *             allows and without errors
+     * framing: transfer keep and last of every beat like a core that is
+     *          built with USE_FRAMING. Not supported by shm
+     */
+    BasicAuroraEmu(std::string protocol, std::string name,
+                   hlslib::Stream<T> &user_to_remote,
+                   hlslib::Stream<T> &remote_to_user,
+                   size_t batch_size = DEFAULT_BATCH_SIZE,
+                   int flush_timeout_us = DEFAULT_FLUSH_TIMEOUT,
+                   size_t ring_depth = DEFAULT_RING_DEPTH,
+                   AuroraEmuLinkModel link_model =
+                       AuroraEmuLinkModel::unlimited(),
+                   bool framing = false)
         : ctx(1),
-          sock_out(ctx, zmq::socket_type::pub),
+          sock_out(ctx, zmq::socket_type::xpub),
           sock_in(ctx, zmq::socket_type::sub),
           kill_socket(ctx, zmq::socket_type::pub),
           user_to_remote(user_to_remote),
           remote_to_user(remote_to_user),
-          id(host_address + ":" + std::to_string(port)),
-          protocol("tcp") {
-        sock_out.bind(protocol + "://" + id);
+          id(name),
+          protocol(protocol),
+          running(true),
+          batch_size(batch_size),
+          flush_timeout_us(flush_timeout_us),
+          framing(framing),
+          link_model(link_model),
+          tx_pool(batch_size * (beat_bytes + sizeof(AuroraEmuSideband)) +
+                  sizeof(uint64_t)),
+          trace(nullptr),
+          connected(false) {
+        if (framing && protocol == "shm") {
+            throw std::invalid_argument(
+                "Framing is not supported by the shm protocol");
+        }
+        if (link_model.has_latency()) {
+            delay_line.reset(new AuroraEmuDelayLine(link_model.get_latency()));
+        }
+        if (protocol == "shm") {
+            ring_out.reset(
+                new AuroraEmuRing(ring_name(get_address()), ring_depth,
+                                  beat_bytes));
+        } else if (protocol == "tcp" || protocol == "ipc") {
+            // apply back pressure instead of dropping data if the receiver
+            // does not keep up
+            sock_out.set(zmq::sockopt::xpub_nodrop, true);
+            sock_out.set(zmq::sockopt::sndtimeo, RETRY_INTERVAL);
+            sock_out.bind(protocol + "://" + id);
+        } else {
+            throw std::invalid_argument("Unsupported protocol " + protocol);
+        }
         kill_socket.bind("inproc://kill_" + id);
     }
 
-    AuroraEmu(std::string pipe_name,
-              hlslib::Stream<data_stream_t> &user_to_remote,
-              hlslib::Stream<data_stream_t> &remote_to_user)
-        : ctx(1),
-          sock_out(ctx, zmq::socket_type::pub),
-          sock_in(ctx, zmq::socket_type::sub),
-          kill_socket(ctx, zmq::socket_type::pub),
-          user_to_remote(user_to_remote),
-          remote_to_user(remote_to_user),
-          id(pipe_name),
-          protocol("ipc") {
-        sock_out.bind(protocol + "://" + id);
-        kill_socket.bind("inproc://kill_" + id);
-    }
+    BasicAuroraEmu(std::string host_address, int port,
+                   hlslib::Stream<T> &user_to_remote,
+                   hlslib::Stream<T> &remote_to_user,
+                   size_t batch_size = DEFAULT_BATCH_SIZE,
+                   int flush_timeout_us = DEFAULT_FLUSH_TIMEOUT,
+                   AuroraEmuLinkModel link_model =
+                       AuroraEmuLinkModel::unlimited(),
+                   bool framing = false)
+        : BasicAuroraEmu("tcp", host_address + ":" + std::to_string(port),
+                         user_to_remote, remote_to_user, batch_size,
+                         flush_timeout_us, DEFAULT_RING_DEPTH, link_model,
+                         framing) {}
 
-    ~AuroraEmu() {
+    BasicAuroraEmu(std::string pipe_name, hlslib::Stream<T> &user_to_remote,
+                   hlslib::Stream<T> &remote_to_user,
+                   size_t batch_size = DEFAULT_BATCH_SIZE,
+                   int flush_timeout_us = DEFAULT_FLUSH_TIMEOUT,
+                   AuroraEmuLinkModel link_model =
+                       AuroraEmuLinkModel::unlimited(),
+                   bool framing = false)
+        : BasicAuroraEmu("ipc", pipe_name, user_to_remote, remote_to_user,
+                         batch_size, flush_timeout_us, DEFAULT_RING_DEPTH,
+                         link_model, framing) {}
+
+    ~BasicAuroraEmu() {
         // send kill signal to all threads
         // and wait for them to join
+        running = false;
         zmq::message_t t(0);
         kill_socket.send(t, zmq::send_flags::none);
         if (recv_thread.joinable()) {
             recv_thread.join();
         }
+        if (delay_thread.joinable()) {
+            delay_line->close();
+            delay_thread.join();
+        }
         if (send_thread.joinable()) {
             send_thread.join();
         }
     }
 
-    void connect(AuroraEmu &other_core, bool bidirectional = true) {
-        if ((get_address() != other_core.get_address()) && bidirectional)
-            other_core.connect(*this, false);
-        sock_in.connect(other_core.get_address());
-        sock_in.set(zmq::sockopt::subscribe, "");
-        std::thread t1(&AuroraEmu::forward_from_remote, this);
-        std::thread t2(&AuroraEmu::forward_from_user, this);
-        recv_thread.swap(t1);
-        send_thread.swap(t2);
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(RECV_POLL_INTERVAL));
+    /**
+     * Connect to another emulator in the same process and wait until data
+     * sent by the other emulator is received. With bidirectional, the other
+     * emulator is connected to this emulator, too
+     */
+    void connect(BasicAuroraEmu &other_core, bool bidirectional = true) {
+        if ((get_address() != other_core.get_address()) && bidirectional) {
+            other_core.connect(get_address());
+        }
+        connect(other_core.get_address());
+        if (!other_core.wait_until_connected(DEFAULT_CONNECT_TIMEOUT) ||
+            (bidirectional && !wait_until_connected(DEFAULT_CONNECT_TIMEOUT))) {
+            throw std::runtime_error("Could not connect " + get_address() +
+                                     " and " + other_core.get_address());
+        }
+    }
+
+    /**
+     * Receive data from the emulator with the given address and start
+     * forwarding. Can be used to connect to an emulator in another process.
+     * A shm ring can only be read by a single emulator. Does not wait for
+     * the remote emulator, use wait_until_connected() on both sides.
+     *
+     * remote_address: address of the remote emulator as returned by
+     *                 get_address(). Has to use the same protocol
+     */
+    void connect(std::string remote_address) {
+        if (remote_address.compare(0, protocol.size() + 3,
+                                   protocol + "://") != 0) {
+            throw std::invalid_argument("Can not connect " + get_address() +
+                                        " to " + remote_address);
+        }
+        this->remote_address = remote_address;
+        if (protocol == "shm") {
+            ring_in.reset(new AuroraEmuRing(ring_name(remote_address)));
+            if (ring_in->beat_bytes() != beat_bytes) {
+                throw std::invalid_argument(
+                    "Beat width of " + remote_address +
+                    " does not match the width of this emulator");
+            }
+            std::thread t1(&BasicAuroraEmu::forward_from_remote_shm, this);
+            std::thread t2(&BasicAuroraEmu::forward_from_user_shm, this);
+            recv_thread.swap(t1);
+            send_thread.swap(t2);
+            set_connected();
+        } else {
+            sock_in.connect(remote_address);
+            sock_in.set(zmq::sockopt::subscribe, "");
+            std::thread t1(&BasicAuroraEmu::forward_from_remote, this);
+            std::thread t2(&BasicAuroraEmu::forward_from_user, this);
+            recv_thread.swap(t1);
+            send_thread.swap(t2);
+        }
+        if (delay_line) {
+            std::thread t3(&BasicAuroraEmu::forward_from_delay_line, this);
+            delay_thread.swap(t3);
+        }
+    }
+
+    /**
+     * Wait until a receiver is connected to this emulator, so data written
+     * to the user_to_remote stream is not lost. Data is held back until
+     * then. Has to be called after connect(). The shm ring buffers data
+     * until the receiver attaches, so shm emulators are connected as soon
+     * as connect() was called
+     *
+     * timeout_ms: maximum time to wait in milliseconds
+     *
+     * Returns false if no receiver connected in time
+     */
+    bool wait_until_connected(int timeout_ms = DEFAULT_CONNECT_TIMEOUT) {
+        std::unique_lock<std::mutex> lock(connected_mutex);
+        return connected_cv.wait_for(lock,
+                                     std::chrono::milliseconds(timeout_ms),
+                                     [this] { return connected; });
     }
 
     std::string get_address() { return protocol + "://" + id; }
+
+    /**
+     * Live statistics of the emulator. The queue depth is the number of
+     * beats in the delay line of the link model. The latency is measured
+     * from packing a batch until it leaves the delay line and is not
+     * available for shm
+     */
+    AuroraEmuStats &get_stats() { return stats; }
+
+    /**
+     * Record all received data in a trace until set_trace() is called with
+     * nullptr. The trace has to outlive the recording
+     */
+    void set_trace(AuroraEmuTraceWriter *writer) {
+        if (writer && (writer->get_beat_bytes() != beat_bytes ||
+                       writer->has_framing() != framing)) {
+            throw std::invalid_argument(
+                "Beat format of the trace does not match " + get_address());
+        }
+        trace.store(writer, std::memory_order_release);
+    }
+
+    /**
+     * Write the address and the statistics of the emulator as JSON object
+     */
+    void write_stats_json(std::ostream &out) {
+        out << "{\"address\": ";
+        write_json_string(out, get_address());
+        out << ", \"stats\": ";
+        stats.write_json(out);
+        out << "}";
+    }
 };
 
+typedef BasicAuroraEmu<data_stream_t> AuroraEmu;
+
 class AuroraEmuSwitch {
    private:
-    // ZMQ sockets used to exchange data between Aurora cores
+    // ZMQ context with one I/O thread per shard
     zmq::context_t ctx;
-    zmq::socket_t distributor;
-    zmq::socket_t incoming;
 
-    // ZMQ socket used to terminate the switch thread
+    // ZMQ socket used by cores to look up the number of shards and the
+    // direct endpoints of other cores
+    zmq::socket_t directory;
+
+    // direct endpoints registered by the cores. Only used by the thread of
+    // the first shard
+    std::map<std::string, std::string> endpoints;
+
+    // one ROUTER socket per shard. Every core is connected to every shard
+    // for sending and to the shard of its own ID for receiving
+    std::vector<zmq::socket_t> shards;
+
+    // ZMQ sockets used to terminate the shard threads
     zmq::socket_t kill_socket;
-    zmq::socket_t kill_listener;
+    std::vector<zmq::socket_t> kill_listeners;
 
-    // send and recv threads used to pass data to and from user kernels
-    std::thread switch_thread;
+    // threads that route the messages of one shard each
+    std::vector<std::thread> shard_threads;
 
     // ZMQ address of the kill socket for this switch
     std::string kill_id;
 
-    void forward_data() {
-        zmq::message_t msg;
-        // listen to kill signals and data coming in
-        zmq::pollitem_t items[] = {{incoming, 0, ZMQ_POLLIN, 0},
-                                   {kill_listener, 0, ZMQ_POLLIN, 0}};
+    // cleared to stop blocked shard threads
+    std::atomic<bool> running;
+
+    // statistics of every shard
+    std::vector<std::unique_ptr<AuroraEmuStats>> shard_stats;
+
+    // send a message to the core with the given ID. Blocks while the core
+    // does not keep up. Returns false if the core is not connected anymore
+    bool route(zmq::socket_t &router, const std::string &destination,
+               std::vector<zmq::message_t> &frames) {
+        zmq::message_t a_id(destination);
+        try {
+            while (!router.send(a_id, zmq::send_flags::sndmore)) {
+                if (!running) {
+                    return true;
+                }
+            }
+        } catch (zmq::error_t &e) {
+            if (e.num() != EHOSTUNREACH) {
+                throw;
+            }
+            return false;
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            router.send(frames[i], i + 1 < frames.size()
+                                       ? zmq::send_flags::sndmore
+                                       : zmq::send_flags::none);
+        }
+        return true;
+    }
+
+    // requests consist of a command and its arguments:
+    // "shards": reply with the number of shards
+    // "register" id port: store the endpoint of a core that receives data
+    //                     directly from other cores on the given port
+    // "resolve" id: reply with the direct endpoint of a core or an empty
+    //               frame if the core has to be reached via the switch
+    void answer_directory_request() {
+        zmq::message_t identity, empty;
+        std::vector<zmq::message_t> request;
+        auto result = directory.recv(identity, zmq::recv_flags::none);
+        result = directory.recv(empty, zmq::recv_flags::none);
+        do {
+            request.emplace_back();
+            result = directory.recv(request.back(), zmq::recv_flags::none);
+        } while (request.back().more());
+        std::string command = request[0].to_string();
+        std::string answer;
+        if (command == "shards") {
+            answer = std::to_string(shards.size());
+        } else if (command == "register" && request.size() == 3) {
+            // the core is reachable at the address it used to connect to
+            // the switch
+            std::string host = request[0].gets("Peer-Address");
+            if (host.find(':') != std::string::npos) {
+                host = "[" + host + "]";
+            }
+            endpoints[request[1].to_string()] =
+                "tcp://" + host + ":" + request[2].to_string();
+        } else if (command == "resolve" && request.size() == 2) {
+            auto endpoint = endpoints.find(request[1].to_string());
+            if (endpoint != endpoints.end()) {
+                answer = endpoint->second;
+            }
+        }
+        zmq::message_t reply(answer);
+        directory.send(identity, zmq::send_flags::sndmore);
+        directory.send(empty, zmq::send_flags::sndmore);
+        directory.send(reply, zmq::send_flags::none);
+    }
+
+    void forward_data(size_t shard) {
+        zmq::socket_t &router = shards[shard];
+        AuroraEmuStats &stats = *shard_stats[shard];
+        zmq::message_t identity, destination;
+        // cores that completed the handshake with this shard. Messages to
+        // other cores are held back until they connect
+        std::set<std::string> connected;
+        std::map<std::string, std::deque<std::vector<zmq::message_t>>>
+            pending;
+        // listen to kill signals and data coming in. The first shard also
+        // answers directory requests
+        zmq::pollitem_t items[] = {{router, 0, ZMQ_POLLIN, 0},
+                                   {kill_listeners[shard], 0, ZMQ_POLLIN, 0},
+                                   {directory, 0, ZMQ_POLLIN, 0}};
         while (true) {
-            zmq::poll(&items[0], 2);
+            zmq::poll(&items[0], shard == 0 ? 3 : 2);
             if (items[0].revents & ZMQ_POLLIN) {
-                // forward topic
-                auto result = incoming.recv(msg, zmq::recv_flags::none);
-                distributor.send(msg, zmq::send_flags::sndmore);
-                // forward content
-                result = incoming.recv(msg, zmq::recv_flags::none);
-                distributor.send(msg, zmq::send_flags::none);
+                // the first frame is the identity of the sending socket. The
+                // next frame is the ID of the destination, which is used by
+                // the ROUTER socket to address the receiving core. A single
+                // empty frame announces a core that wants to receive data
+                auto result = router.recv(identity, zmq::recv_flags::none);
+                result = router.recv(destination, zmq::recv_flags::none);
+                if (!destination.more()) {
+                    std::string id = identity.to_string();
+                    connected.insert(id);
+                    router.send(identity, zmq::send_flags::sndmore);
+                    router.send(destination, zmq::send_flags::none);
+                    std::deque<std::vector<zmq::message_t>> &queue =
+                        pending[id];
+                    while (!queue.empty() && route(router, id, queue.front())) {
+                        stats.add_tx(0, queue.front().back().size());
+                        stats.add_queue_depth(-1);
+                        queue.pop_front();
+                    }
+                    if (queue.empty()) {
+                        pending.erase(id);
+                    } else {
+                        connected.erase(id);
+                    }
+                } else {
+                    std::vector<zmq::message_t> frames;
+                    do {
+                        frames.emplace_back();
+                        result =
+                            router.recv(frames.back(), zmq::recv_flags::none);
+                    } while (frames.back().more());
+                    // data batches end with the time they were sent, flow
+                    // control messages consist of a single byte
+                    size_t bytes = frames.back().size();
+                    stats.add_rx(0, bytes);
+                    if (bytes > sizeof(uint64_t)) {
+                        uint64_t sent =
+                            batch_timestamp(frames.back().data(), bytes);
+                        uint64_t now = timestamp_ns();
+                        stats.add_latency(now > sent ? now - sent : 0);
+                    }
+                    std::string id = destination.to_string();
+                    if (connected.count(id) && route(router, id, frames)) {
+                        stats.add_tx(0, bytes);
+                    } else {
+                        connected.erase(id);
+                        stats.add_queue_depth(1);
+                        pending[id].push_back(std::move(frames));
+                    }
+                }
+            }
+            if (shard == 0 && (items[2].revents & ZMQ_POLLIN)) {
+                answer_directory_request();
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
@@ -194,65 +1004,169 @@ class AuroraEmuSwitch {
 
    public:
     /**
-     * Construct and connect a new aurora switch and do not start thread
-     * to listen for incoming connections. Thread has to be started with
+     * Shard that routes the messages to the core with the given ID.
+     * Uses FNV-1a, so the result is the same in all processes
+     */
+    static size_t shard_of(const std::string &id, size_t num_shards) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : id) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash % num_shards;
+    }
+
+    /**
+     * Construct a new aurora switch and do not start threads
+     * to listen for incoming connections. Threads have to be started with
      * additional call to listen()
      *
      */
-    AuroraEmuSwitch()
-        : ctx(1),
-          incoming(ctx, zmq::socket_type::pull),
-          distributor(ctx, zmq::socket_type::pub),
-          kill_socket(ctx, zmq::socket_type::pub),
-          kill_listener(ctx, zmq::socket_type::sub),
-          kill_id("") {}
+    AuroraEmuSwitch() : kill_id(""), running(true) {}
 
     /**
-     * Construct and connect a new aurora switch and start thread
+     * Construct and connect a new aurora switch and start threads
      * to listen for new connections
      *
      * host_address: IP address or name of the host machine
-     * port: Port of the aurora switch. port and port+1 will be used to
-     *      establish the switch functionality.
+     * port: Port of the aurora switch. Ports port to port+num_shards will be
+     *       used to establish the switch functionality.
+     * num_shards: number of threads that route messages. Messages are
+     *             assigned to the shards by the ID of their destination
      */
-    AuroraEmuSwitch(std::string host_address, int port) : AuroraEmuSwitch() {
-        this->listen(host_address, port);
-    }
-
-    void listen(std::string host_address, int port) {
-        if (!switch_thread.joinable()) {
-            kill_id =
-                "inproc://kill_" + host_address + "_" + std::to_string(port);
-            incoming.bind("tcp://" + host_address + ":" + std::to_string(port));
-            distributor.bind("tcp://" + host_address + ":" +
-                             std::to_string(port + 1));
-            kill_socket.bind(kill_id);
-            kill_listener.connect(kill_id);
-            kill_listener.set(zmq::sockopt::subscribe, "");
-            switch_thread = std::thread(&AuroraEmuSwitch::forward_data, this);
-        } else {
+    AuroraEmuSwitch(std::string host_address, int port,
+                    size_t num_shards = DEFAULT_SWITCH_SHARDS)
+        : AuroraEmuSwitch() {
+        this->listen(host_address, port, num_shards);
+    }
+
+    void listen(std::string host_address, int port,
+                size_t num_shards = DEFAULT_SWITCH_SHARDS) {
+        if (!shard_threads.empty()) {
             throw std::runtime_error("Switch already running!");
         }
+        if (num_shards == 0) {
+            throw std::invalid_argument("Switch needs at least one shard");
+        }
+        ctx.set(zmq::ctxopt::io_threads, static_cast<int>(num_shards));
+        kill_id = "inproc://kill_" + host_address + "_" + std::to_string(port);
+        kill_socket = zmq::socket_t(ctx, zmq::socket_type::pub);
+        kill_socket.bind(kill_id);
+        directory = zmq::socket_t(ctx, zmq::socket_type::router);
+        directory.bind("tcp://" + host_address + ":" + std::to_string(port));
+        for (size_t i = 0; i < num_shards; i++) {
+            shard_stats.emplace_back(new AuroraEmuStats());
+            shards.emplace_back(ctx, zmq::socket_type::router);
+            // block instead of dropping messages if a core does not keep up
+            shards[i].set(zmq::sockopt::router_mandatory, true);
+            shards[i].set(zmq::sockopt::sndtimeo, RETRY_INTERVAL);
+            shards[i].bind("tcp://" + host_address + ":" +
+                           std::to_string(port + 1 + i));
+            kill_listeners.emplace_back(ctx, zmq::socket_type::sub);
+            kill_listeners[i].connect(kill_id);
+            kill_listeners[i].set(zmq::sockopt::subscribe, "");
+        }
+        for (size_t i = 0; i < num_shards; i++) {
+            shard_threads.emplace_back(&AuroraEmuSwitch::forward_data, this,
+                                       i);
+        }
+    }
+
+    size_t get_num_shards() { return shards.size(); }
+
+    /**
+     * Live statistics of a shard. The switch does not know the width of
+     * the beats, so only messages and bytes are counted. The queue depth
+     * is the number of messages held back for cores that are not
+     * connected. The latency is measured from packing a batch until it
+     * arrives at the switch
+     */
+    AuroraEmuStats &get_shard_stats(size_t shard) {
+        return *shard_stats.at(shard);
+    }
+
+    /**
+     * Write the statistics of all shards as JSON object
+     */
+    void write_stats_json(std::ostream &out) {
+        out << "{\"shards\": [";
+        for (size_t i = 0; i < shard_stats.size(); i++) {
+            out << (i ? ", " : "") << "{\"shard\": " << i
+                << ", \"stats\": ";
+            shard_stats[i]->write_json(out);
+            out << "}";
+        }
+        out << "]}";
     }
 
     ~AuroraEmuSwitch() {
         // send kill signal to all threads
         // and wait for them to join
-        if (switch_thread.joinable()) {
+        if (!shard_threads.empty()) {
+            running = false;
             zmq::message_t t(0);
             kill_socket.send(t, zmq::send_flags::none);
-            switch_thread.join();
+            for (auto &thread : shard_threads) {
+                thread.join();
+            }
         }
     }
 };
 
-class AuroraEmuCore {
+/**
+ * Emulated Aurora core that is connected to an AuroraEmuSwitch.
+ * T is the type of the AXI streams of the user kernels
+ */
+template <typename T>
+class BasicAuroraEmuCore : private AuroraEmuTask {
    private:
-    // ZMQ sockets used to exchange data between Aurora cores
+    // bytes of a beat on the wire
+    enum { beat_bytes = AuroraEmuStreamTraits<T>::bytes };
+
+    // shared runtime that forwards the data of this core. If not set, the
+    // core uses its own context and threads
+    AuroraEmuRuntime *runtime;
+
+    // ZMQ sockets used to exchange data between Aurora cores. Data is sent
+    // to the shard of the remote core and received from the shard of this
+    // core, which addresses it by its ID
     zmq::context_t ctx;
     zmq::socket_t to_switch;
     zmq::socket_t from_switch;
 
+    // ZMQ sockets used to send flow control messages to the switch, one per
+    // shard. Shared by the recv and deliver threads
+    std::vector<zmq::socket_t> control_to_switch;
+    std::mutex control_mutex;
+    // destinations and codes of the flow control messages that were not
+    // sent yet. poll() leaves messages here that the sockets did not accept
+    std::deque<std::pair<std::string, uint8_t>> control_pending;
+
+    // number of shards of the switch
+    size_t num_shards;
+    // address of the directory of the switch
+    std::string directory_address;
+
+    // direct data path that bypasses the switch. Data of other cores is
+    // received by from_peers, whose endpoint is registered with the
+    // directory. Data is sent via to_peer if the remote core registered
+    // an endpoint before the first beat was sent
+    bool direct;
+    zmq::socket_t from_peers;
+    zmq::socket_t to_peer;
+    bool remote_resolved;
+    std::atomic<bool> remote_direct;
+    // directory request of poll(), which checks for the reply on every
+    // call instead of waiting for it
+    zmq::socket_t resolver;
+    bool resolve_requested;
+    std::chrono::steady_clock::time_point resolve_deadline;
+
+    // set when the switch acknowledged the connection of this core
+    bool connected;
+    std::mutex connected_mutex;
+    std::condition_variable connected_cv;
+
     // ZMQ socket used to terminate send and recv threads
     zmq::socket_t kill_socket;
 
@@ -260,33 +1174,288 @@ class AuroraEmuCore {
     std::thread recv_thread;
     std::thread send_thread;
 
+    // thread used to pass data from the RX FIFO to the user kernel
+    std::thread deliver_thread;
+
     // streams used to pass data to and from user kernels
-    hlslib::Stream<data_stream_t> &remote_to_user;
-    hlslib::Stream<data_stream_t> &user_to_remote;
+    hlslib::Stream<T> &remote_to_user;
+    hlslib::Stream<T> &user_to_remote;
 
     // id that is used to name the socket of the aurora emulator
     // or the network port
     std::string id;
     std::string remote_id;
 
+    // cleared to terminate the TX thread
+    std::atomic<bool> running;
+
+    // batching of beats into ZMQ messages
+    size_t batch_size;
+    int flush_timeout_us;
+
+    // transfer keep and last of every beat and count frames
+    bool framing;
+    // a beat of the current frame was corrupted by the error model
+    bool frame_corrupted;
+
+    // bounded RX FIFO with thresholds for the native flow control
+    AuroraEmuFifo<T> rx_fifo;
+    std::mutex rx_fifo_mutex;
+    std::condition_variable rx_fifo_cv;
+    size_t rx_fifo_depth;
+    size_t rx_fifo_prog_full;
+    size_t rx_fifo_prog_empty;
+    // received beats that did not fit into the RX FIFO. No data is read
+    // from the sockets until they were moved into the RX FIFO, so the RX
+    // FIFO never holds more than rx_fifo_depth beats
+    AuroraEmuFifo<T> rx_pending;
+    // cores that sent data to this core and have to be notified by XON/XOFF
+    std::set<std::string> senders;
+    // sender of the last received batch, which is already in senders
+    std::string last_sender;
+    bool xoff_sent;
+    // beats received since the last XOFF was sent
+    uint32_t nfc_latency;
+
+    // TX is paused while the remote RX FIFO is full
+    bool tx_paused;
+    std::mutex tx_mutex;
+    std::condition_variable tx_cv;
+
+    // status and counter registers of the emulated core
+    AuroraEmuRegisters registers;
+
+    // timing model of the link. Received data is passed through the delay
+    // line into the RX FIFO by an additional thread if the link has a
+    // latency
+    AuroraEmuLinkModel link_model;
+    std::unique_ptr<AuroraEmuDelayLine> delay_line;
+    std::thread delay_thread;
+
+    // buffers of poll(), which is used instead of the threads if the core
+    // is registered with a runtime
+    std::vector<char> rx_payload;
+    std::vector<T> tx_batch;
+    // packed batch and its number of beats, which is kept by poll() until
+    // the socket accepts it. tx_beats is 0 if no batch is waiting
+    zmq::message_t tx_msg;
+    size_t tx_beats;
+    // TX stall was already counted for the current pause
+    bool tx_stalled;
+
+    // buffers of the sent batches, which are passed to ZMQ without copying
+    AuroraEmuBufferPool tx_pool;
+    // forwarded data, RX FIFO fill level and latency of received batches
+    AuroraEmuStats stats;
+    // records received batches if set
+    std::atomic<AuroraEmuTraceWriter *> trace;
+    // received messages, which are reused for every message
+    zmq::message_t rx_source;
+    zmq::message_t rx_msg;
+
+    // has to be called with the rx_fifo_mutex held
+    void update_fifo_status() {
+        uint32_t status = 0;
+        if (rx_fifo.size() <= rx_fifo_prog_empty) {
+            status |= AuroraEmuRegisters::FIFO_RX_PROG_EMPTY;
+        }
+        if (rx_fifo.size() >= rx_fifo_prog_full) {
+            status |= AuroraEmuRegisters::FIFO_RX_PROG_FULL;
+        }
+        registers.set(AuroraEmuRegisters::FIFO_STATUS, status);
+        stats.set_queue_depth(rx_fifo.size());
+    }
+
+    // send a flow control message to all senders. Has to be called with
+    // the rx_fifo_mutex held, so XON and XOFF leave in the order in which
+    // they were decided
+    void send_control(uint8_t code) {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        for (auto &destination : senders) {
+            control_pending.emplace_back(destination, code);
+        }
+        flush_control();
+    }
+
+    // send the pending flow control messages in order. poll() must not
+    // block the worker, so it stops at the first message that the socket
+    // does not accept and tries again on the next call. Has to be called
+    // with the control_mutex held
+    void flush_control() {
+        zmq::send_flags flags =
+            runtime ? zmq::send_flags::dontwait : zmq::send_flags::none;
+        while (!control_pending.empty()) {
+            const std::string &destination = control_pending.front().first;
+            uint8_t code = control_pending.front().second;
+            zmq::message_t a_id(destination);
+            zmq::message_t source(id);
+            zmq::message_t msg(static_cast<void *>(&code), sizeof(code));
+            zmq::socket_t &control = control_to_switch[
+                AuroraEmuSwitch::shard_of(destination, num_shards)];
+            // the remaining frames of a message are always accepted once
+            // the first one was
+            if (!control.send(a_id, flags | zmq::send_flags::sndmore)) {
+                return;
+            }
+            control.send(source, zmq::send_flags::sndmore);
+            control.send(msg, zmq::send_flags::none);
+            control_pending.pop_front();
+        }
+    }
+
+    void handle_control(uint8_t code) {
+        std::lock_guard<std::mutex> lock(tx_mutex);
+        tx_paused = (code == NFC_XOFF);
+        tx_cv.notify_all();
+    }
+
+    void add_sender(std::string source) {
+        std::lock_guard<std::mutex> lock(rx_fifo_mutex);
+        senders.insert(source);
+    }
+
+    // has to be called with the rx_fifo_mutex held
+    void receive_beat(T &beat) {
+        if (link_model.has_errors() &&
+            link_model.inject_errors(beat.data, !framing || beat.last)) {
+            frame_corrupted = true;
+        }
+        // count frames like aurora_flow_monitor
+        if (framing && beat.last) {
+            registers.add(AuroraEmuRegisters::FRAMES_RECEIVED, 1);
+            if (frame_corrupted) {
+                registers.add(AuroraEmuRegisters::FRAMES_WITH_ERRORS, 1);
+            }
+            frame_corrupted = false;
+        }
+        rx_pending.push_back(beat);
+    }
+
+    // move received beats into the RX FIFO while it has space and send
+    // XOFF when the fill level reaches prog_full. Has to be called with the
+    // rx_fifo_mutex held
+    void fill_rx_fifo() {
+        while (!rx_pending.empty() && rx_fifo.size() < rx_fifo_depth) {
+            rx_fifo.push_back(rx_pending.front());
+            rx_pending.pop_front();
+        }
+        if (!xoff_sent && rx_fifo.size() >= rx_fifo_prog_full) {
+            xoff_sent = true;
+            nfc_latency = 0;
+            registers.add(AuroraEmuRegisters::NFC_FULL_TRIGGER_COUNT, 1);
+            send_control(NFC_XOFF);
+        }
+        update_fifo_status();
+    }
+
+    void push_rx_fifo(const void *payload, size_t bytes) {
+        uint64_t sent = batch_timestamp(payload, bytes);
+        uint64_t now = timestamp_ns();
+        {
+            std::unique_lock<std::mutex> lock(rx_fifo_mutex);
+            size_t beats = unpack_batch<T>(payload, bytes, framing,
+                                           [this](T &beat) {
+                                               receive_beat(beat);
+                                           });
+            registers.add(AuroraEmuRegisters::RX_COUNT, beats);
+            stats.add_rx(beats, beats * beat_bytes);
+            stats.add_latency(now > sent ? now - sent : 0, beats);
+            if (xoff_sent) {
+                nfc_latency += beats;
+            }
+            // beats that do not fit are held back instead of being dropped,
+            // but counted as overflow like in hardware
+            size_t space = rx_fifo_depth - rx_fifo.size();
+            if (beats > space) {
+                registers.add(AuroraEmuRegisters::FIFO_RX_OVERFLOW_COUNT,
+                              beats - space);
+            }
+            fill_rx_fifo();
+            // the receiving thread waits until the held back beats fit, so
+            // no more data is read from the sockets. poll() checks
+            // rx_pending instead
+            while (!runtime && !rx_pending.empty()) {
+                rx_fifo_cv.notify_all();
+                rx_fifo_cv.wait(lock, [this] {
+                    return rx_fifo.size() < rx_fifo_depth || !running;
+                });
+                if (!running) {
+                    return;
+                }
+                fill_rx_fifo();
+            }
+        }
+        rx_fifo_cv.notify_all();
+    }
+
+    // poll() only receives data if all received beats are in the RX FIFO
+    bool can_receive() {
+        std::lock_guard<std::mutex> lock(rx_fifo_mutex);
+        return rx_pending.empty();
+    }
+
+    // receive a single message from the switch or directly from another
+    // core. Returns false if no message was available
+    bool receive_message(zmq::socket_t &socket, zmq::recv_flags flags) {
+        zmq::message_t &source = rx_source;
+        zmq::message_t &msg = rx_msg;
+        // receive aurora id of the sender. The own id was already
+        // consumed by the switch to address this core. A single
+        // empty frame acknowledges the connection
+        if (!socket.recv(source, flags)) {
+            return false;
+        }
+        if (!source.more()) {
+            std::lock_guard<std::mutex> lock(connected_mutex);
+            connected = true;
+            connected_cv.notify_all();
+            return true;
+        }
+        // receive actual message, which is either a batch of data
+        // or a single flow control byte. ZMQ delivers the frames of a
+        // message together, so this never blocks
+        if (!socket.recv(msg, zmq::recv_flags::none)) {
+            return false;
+        }
+        if (msg.size() == sizeof(uint8_t)) {
+            handle_control(*static_cast<uint8_t *>(msg.data()));
+            return true;
+        }
+        // the sender is only looked up if it changed, so no string is
+        // built for every batch
+        if (source.size() != last_sender.size() ||
+            std::memcmp(source.data(), last_sender.data(), source.size())) {
+            last_sender = source.to_string();
+            add_sender(last_sender);
+        }
+        AuroraEmuTraceWriter *writer = trace.load(std::memory_order_acquire);
+        if (writer) {
+            writer->record(last_sender, id, timestamp_ns(), msg.data(),
+                           msg.size() - sizeof(uint64_t));
+        }
+        if (delay_line) {
+            delay_line->push(msg.data(), msg.size());
+        } else {
+            push_rx_fifo(msg.data(), msg.size());
+        }
+        return true;
+    }
+
     void forward_from_remote() {
         zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
         kill_listener.connect("inproc://kill_" + id);
         kill_listener.set(zmq::sockopt::subscribe, "");
-        zmq::message_t msg;
         // listen to kill signals and data coming in
         zmq::pollitem_t items[] = {{from_switch, 0, ZMQ_POLLIN, 0},
-                                   {kill_listener, 0, ZMQ_POLLIN, 0}};
+                                   {kill_listener, 0, ZMQ_POLLIN, 0},
+                                   {from_peers, 0, ZMQ_POLLIN, 0}};
         while (true) {
-            zmq::poll(&items[0], 2);
+            zmq::poll(&items[0], direct ? 3 : 2);
             if (items[0].revents & ZMQ_POLLIN) {
-                // receive aurora id of incoming message. Discard
-                auto result = from_switch.recv(msg, zmq::recv_flags::none);
-                // receive actual message
-                result = from_switch.recv(msg, zmq::recv_flags::none);
-                data_stream_t data;
-                data.data = *static_cast<ap_uint<512> *>(msg.data());
-                remote_to_user.write(data);
+                receive_message(from_switch, zmq::recv_flags::none);
+            }
+            if (direct && (items[2].revents & ZMQ_POLLIN)) {
+                receive_message(from_peers, zmq::recv_flags::none);
             }
             if (items[1].revents & ZMQ_POLLIN) {
                 break;
@@ -294,29 +1463,420 @@ class AuroraEmuCore {
         }
     }
 
-    void forward_from_user() {
-        zmq::socket_t kill_listener(ctx, zmq::socket_type::sub);
-        kill_listener.connect("inproc://kill_" + id);
-        kill_listener.set(zmq::sockopt::subscribe, "");
+    void forward_from_delay_line() {
+        std::vector<char> payload;
+        while (delay_line->pop(payload)) {
+            push_rx_fifo(payload.data(), payload.size());
+        }
+    }
+
+    zmq::context_t &get_context() {
+        return runtime ? runtime->context() : ctx;
+    }
+
+    // send a request to the directory of the switch and return the reply
+    std::string request_directory(const std::vector<std::string> &request) {
+        zmq::socket_t directory(get_context(), zmq::socket_type::req);
+        directory.set(zmq::sockopt::linger, 0);
+        directory.set(zmq::sockopt::rcvtimeo, DEFAULT_CONNECT_TIMEOUT);
+        directory.connect(directory_address);
+        for (size_t i = 0; i < request.size(); i++) {
+            zmq::message_t frame(request[i]);
+            directory.send(frame, i + 1 < request.size()
+                                      ? zmq::send_flags::sndmore
+                                      : zmq::send_flags::none);
+        }
+        zmq::message_t reply;
+        if (!directory.recv(reply, zmq::recv_flags::none)) {
+            throw std::runtime_error("Switch at " + directory_address +
+                                     " did not respond");
+        }
+        return reply.to_string();
+    }
+
+    // choose the path to the remote core. This is only done once before
+    // the first batch is sent, so beats are never reordered between the
+    // two paths. Remote cores that did not register an endpoint yet are
+    // reached via the switch
+    void resolve_remote() {
+        remote_resolved = true;
+        if (!direct) {
+            return;
+        }
+        connect_remote(request_directory({"resolve", remote_id}));
+    }
+
+    // non-blocking variant of resolve_remote() for poll(). The request is
+    // sent on the first call and the reply is checked on the following
+    // calls. Returns true once the path is chosen. If the directory does
+    // not answer in time, data is sent via the switch
+    bool poll_resolve_remote() {
+        if (!direct) {
+            remote_resolved = true;
+            return true;
+        }
+        if (!resolve_requested) {
+            resolver = zmq::socket_t(get_context(), zmq::socket_type::req);
+            resolver.set(zmq::sockopt::linger, 0);
+            resolver.connect(directory_address);
+            zmq::message_t command(std::string("resolve"));
+            zmq::message_t remote(remote_id);
+            // a new socket queues the request for the pending connection
+            resolver.send(command, zmq::send_flags::sndmore);
+            resolver.send(remote, zmq::send_flags::none);
+            resolve_requested = true;
+            resolve_deadline =
+                std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(DEFAULT_CONNECT_TIMEOUT);
+            return false;
+        }
+        zmq::message_t reply;
+        if (!resolver.recv(reply, zmq::recv_flags::dontwait) &&
+            std::chrono::steady_clock::now() < resolve_deadline) {
+            return false;
+        }
+        resolver.close();
+        remote_resolved = true;
+        connect_remote(reply.to_string());
+        return true;
+    }
+
+    // send data directly to the remote core if it registered an endpoint
+    void connect_remote(const std::string &endpoint) {
+        if (endpoint.empty()) {
+            return;
+        }
+        to_peer = zmq::socket_t(get_context(), zmq::socket_type::push);
+        // the context must not wait forever for a remote core that is gone
+        to_peer.set(zmq::sockopt::linger, RETRY_INTERVAL);
+        to_peer.connect(endpoint);
+        remote_direct = true;
+    }
+
+    // has to be called with the rx_fifo_mutex held and a non-empty RX FIFO
+    T pop_rx_fifo() {
+        T beat = rx_fifo.front();
+        rx_fifo.pop_front();
+        if (xoff_sent && rx_fifo.size() <= rx_fifo_prog_empty) {
+            xoff_sent = false;
+            registers.add(AuroraEmuRegisters::NFC_EMPTY_TRIGGER_COUNT, 1);
+            registers.max(AuroraEmuRegisters::NFC_LATENCY_COUNT, nfc_latency);
+            send_control(NFC_XON);
+        }
+        update_fifo_status();
+        return beat;
+    }
+
+    void forward_to_user() {
         while (true) {
-            // check if stream is empty. If so, sleep a bit to reduce CPU load
-            while (user_to_remote.empty()) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(RECV_POLL_INTERVAL));
-                // check for kill signals in between
-                zmq::message_t m;
-                if (kill_listener.recv(m, zmq::recv_flags::dontwait)
-                        .has_value()) {
+            T beat;
+            {
+                std::unique_lock<std::mutex> lock(rx_fifo_mutex);
+                rx_fifo_cv.wait(
+                    lock, [this] { return !rx_fifo.empty() || !running; });
+                if (!running) {
                     return;
                 }
+                beat = pop_rx_fifo();
+            }
+            // wake up the receiving thread waiting for space
+            rx_fifo_cv.notify_all();
+            remote_to_user.write(beat);
+        }
+    }
+
+    void send_batch(const std::vector<T> &batch) {
+        pack_tx_batch(batch);
+        if (!remote_resolved) {
+            resolve_remote();
+        }
+        send_tx_batch(zmq::send_flags::none);
+    }
+
+    // pack a batch into tx_msg, which is sent by send_tx_batch()
+    void pack_tx_batch(const std::vector<T> &batch) {
+        size_t frames = pack_batch(batch, framing, tx_msg, &tx_pool);
+        link_model.pace(batch.size() * beat_bytes, frames);
+        tx_beats = batch.size();
+    }
+
+    // send the packed batch. Returns false if the socket did not accept it
+    // with dontwait, the batch is then kept for the next attempt
+    bool send_tx_batch(zmq::send_flags flags) {
+        zmq::socket_t &socket = remote_direct ? to_peer : to_switch;
+        zmq::message_t source(id);
+        // the remaining frames of a message are always accepted once the
+        // first one was
+        if (remote_direct) {
+            if (!socket.send(source, flags | zmq::send_flags::sndmore)) {
+                return false;
             }
-            // forward incoming data to user kernel
-            ap_uint<512> data = user_to_remote.read().data;
-            zmq::message_t msg(static_cast<void *>(&data),
-                               sizeof(ap_uint<512>));
+        } else {
             zmq::message_t a_id(remote_id);
-            to_switch.send(a_id, zmq::send_flags::sndmore);
-            to_switch.send(msg, zmq::send_flags::none);
+            if (!socket.send(a_id, flags | zmq::send_flags::sndmore)) {
+                return false;
+            }
+            socket.send(source, zmq::send_flags::sndmore);
+        }
+        // counted before sending, so the statistics of the receiver never
+        // show more data than the statistics of the sender
+        stats.add_tx(tx_beats, tx_beats * beat_bytes);
+        socket.send(tx_msg, zmq::send_flags::none);
+        registers.add(AuroraEmuRegisters::TX_COUNT, tx_beats);
+        tx_beats = 0;
+        return true;
+    }
+
+    void forward_from_user() {
+        std::vector<T> batch;
+        batch.reserve(batch_size);
+        AuroraEmuBackoff backoff(TX_POLL_INTERVAL);
+        while (true) {
+            // stop draining the TX stream while the remote RX FIFO is full,
+            // so the user kernel sees the back pressure. Every pause is
+            // counted as a TX stall
+            {
+                std::unique_lock<std::mutex> lock(tx_mutex);
+                if (tx_paused) {
+                    registers.add(AuroraEmuRegisters::FIFO_TX_OVERFLOW_COUNT,
+                                  1);
+                }
+                tx_cv.wait(lock, [this] { return !tx_paused || !running; });
+            }
+            if (!running) {
+                return;
+            }
+            // wait for data without reading it, so an XOFF that arrives in
+            // the meantime is checked before the first beat is taken
+            if (user_to_remote.empty()) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            // forward a batch of incoming data to the remote core. The id
+            // frame is only sent once per batch
+            if (read_batch(user_to_remote, batch, batch_size, flush_timeout_us,
+                           running) == 0) {
+                return;
+            }
+            send_batch(batch);
+        }
+    }
+
+    // forward all data that is available without blocking. Used instead of
+    // the threads if the core is registered with a runtime. Sockets that
+    // do not accept data leave it for the next call, so a slow or absent
+    // remote core never stalls the other cores of the worker
+    bool poll() override {
+        bool active = false;
+        {
+            std::lock_guard<std::mutex> lock(control_mutex);
+            flush_control();
+        }
+        // limit the number of messages per call, so all cores of a worker
+        // get their turn. Nothing is received while beats are held back
+        // for the RX FIFO
+        for (size_t i = 0; i < batch_size && can_receive(); i++) {
+            if (!receive_message(from_switch, zmq::recv_flags::dontwait)) {
+                break;
+            }
+            active = true;
+        }
+        for (size_t i = 0; direct && i < batch_size && can_receive(); i++) {
+            if (!receive_message(from_peers, zmq::recv_flags::dontwait)) {
+                break;
+            }
+            active = true;
+        }
+        if (delay_line) {
+            while (can_receive() && delay_line->try_pop(rx_payload)) {
+                push_rx_fifo(rx_payload.data(), rx_payload.size());
+                active = true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(rx_fifo_mutex);
+            while (!rx_fifo.empty() && !remote_to_user.full()) {
+                remote_to_user.write(pop_rx_fifo());
+                fill_rx_fifo();
+                active = true;
+            }
+        }
+        // a batch that was not accepted is sent before new data is read
+        if (tx_beats > 0) {
+            if (!send_tx_batch(zmq::send_flags::dontwait)) {
+                return active;
+            }
+            active = true;
+        }
+        if (user_to_remote.empty()) {
+            return active;
+        }
+        {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            if (tx_paused) {
+                // count every pause once as TX stall
+                if (!tx_stalled) {
+                    registers.add(AuroraEmuRegisters::FIFO_TX_OVERFLOW_COUNT,
+                                  1);
+                    tx_stalled = true;
+                }
+                return active;
+            }
+            tx_stalled = false;
+        }
+        if (!remote_resolved && !poll_resolve_remote()) {
+            return active;
+        }
+        tx_batch.clear();
+        while (tx_batch.size() < batch_size && !user_to_remote.empty()) {
+            tx_batch.push_back(user_to_remote.read());
+        }
+        pack_tx_batch(tx_batch);
+        send_tx_batch(zmq::send_flags::dontwait);
+        return true;
+    }
+
+    // send kill signal to all threads and wait for them to join
+    void stop() {
+        if (runtime) {
+            runtime->remove(this);
+            return;
+        }
+        running = false;
+        zmq::message_t t(0);
+        kill_socket.send(t, zmq::send_flags::none);
+        {
+            std::lock_guard<std::mutex> lock(rx_fifo_mutex);
+            rx_fifo_cv.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            tx_cv.notify_all();
+        }
+        if (recv_thread.joinable()) {
+            recv_thread.join();
+        }
+        if (delay_thread.joinable()) {
+            delay_line->close();
+            delay_thread.join();
+        }
+        if (deliver_thread.joinable()) {
+            deliver_thread.join();
+        }
+        if (send_thread.joinable()) {
+            send_thread.join();
+        }
+    }
+
+    // runtime is nullptr if the core uses its own threads
+    BasicAuroraEmuCore(AuroraEmuRuntime *runtime, std::string switch_address,
+                       int switch_port, std::string id, std::string remote_id,
+                       hlslib::Stream<T> &user_to_remote,
+                       hlslib::Stream<T> &remote_to_user,
+                       size_t batch_size, int flush_timeout_us,
+                       size_t rx_fifo_depth, size_t rx_fifo_prog_full,
+                       size_t rx_fifo_prog_empty, AuroraEmuLinkModel link_model,
+                       bool framing, bool direct)
+        : runtime(runtime),
+          ctx(1),
+          to_switch(runtime ? runtime->context() : ctx,
+                    zmq::socket_type::dealer),
+          from_switch(runtime ? runtime->context() : ctx,
+                      zmq::socket_type::dealer),
+          direct(direct),
+          remote_resolved(false),
+          remote_direct(false),
+          resolve_requested(false),
+          connected(false),
+          user_to_remote(user_to_remote),
+          remote_to_user(remote_to_user),
+          id(id),
+          remote_id(remote_id),
+          running(true),
+          batch_size(batch_size),
+          flush_timeout_us(flush_timeout_us),
+          framing(framing),
+          frame_corrupted(false),
+          rx_fifo(rx_fifo_depth),
+          rx_fifo_depth(rx_fifo_depth),
+          rx_fifo_prog_full(rx_fifo_prog_full),
+          rx_fifo_prog_empty(rx_fifo_prog_empty),
+          xoff_sent(false),
+          nfc_latency(0),
+          tx_paused(false),
+          registers(beat_bytes, rx_fifo_depth, rx_fifo_prog_full,
+                    rx_fifo_prog_empty, framing),
+          link_model(link_model),
+          tx_beats(0),
+          tx_stalled(false),
+          tx_pool(batch_size * (beat_bytes + sizeof(AuroraEmuSideband)) +
+                  sizeof(uint64_t)),
+          trace(nullptr) {
+        if (rx_fifo_prog_empty >= rx_fifo_prog_full ||
+            rx_fifo_prog_full > rx_fifo_depth) {
+            throw std::invalid_argument(
+                "RX FIFO thresholds must satisfy prog_empty < prog_full <= "
+                "depth");
+        }
+        std::string address = "tcp://" + switch_address + ":";
+        directory_address = address + std::to_string(switch_port);
+        num_shards = std::stoul(request_directory({"shards"}));
+        if (direct) {
+            from_peers = zmq::socket_t(get_context(), zmq::socket_type::pull);
+            from_peers.bind("tcp://*:*");
+            std::string endpoint = from_peers.get(zmq::sockopt::last_endpoint);
+            request_directory(
+                {"register", id, endpoint.substr(endpoint.rfind(':') + 1)});
+        }
+        // the own context is only started if the core has its own threads
+        if (!runtime) {
+            kill_socket = zmq::socket_t(ctx, zmq::socket_type::pub);
+            kill_socket.bind("inproc://kill_" + id);
+        }
+        to_switch.connect(
+            address +
+            std::to_string(switch_port + 1 +
+                           AuroraEmuSwitch::shard_of(remote_id, num_shards)));
+        for (size_t i = 0; i < num_shards; i++) {
+            control_to_switch.emplace_back(runtime ? runtime->context() : ctx,
+                                           zmq::socket_type::dealer);
+            control_to_switch[i].connect(address +
+                                         std::to_string(switch_port + 1 + i));
+        }
+        from_switch.set(zmq::sockopt::routing_id, id);
+        from_switch.connect(
+            address +
+            std::to_string(switch_port + 1 +
+                           AuroraEmuSwitch::shard_of(id, num_shards)));
+        // announce this core to its shard, which answers as soon as data
+        // can be routed to it
+        zmq::message_t hello(0);
+        from_switch.send(hello, zmq::send_flags::none);
+        if (link_model.has_latency()) {
+            delay_line.reset(new AuroraEmuDelayLine(link_model.get_latency()));
+        }
+        if (runtime) {
+            runtime->add(this);
+        } else {
+            start_threads();
+        }
+        if (!wait_until_connected(DEFAULT_CONNECT_TIMEOUT)) {
+            stop();
+            throw std::runtime_error("Switch did not acknowledge core " + id);
+        }
+    }
+
+    void start_threads() {
+        std::thread t1(&BasicAuroraEmuCore::forward_from_remote, this);
+        std::thread t2(&BasicAuroraEmuCore::forward_from_user, this);
+        std::thread t3(&BasicAuroraEmuCore::forward_to_user, this);
+        recv_thread.swap(t1);
+        send_thread.swap(t2);
+        deliver_thread.swap(t3);
+        if (delay_line) {
+            std::thread t4(&BasicAuroraEmuCore::forward_from_delay_line, this);
+            delay_thread.swap(t4);
         }
     }
 
@@ -326,48 +1886,164 @@ class AuroraEmuCore {
      *
      * switch_address: IP address or name of the host machine the switch is
      *                  running on
-     * switch_port: Port of the aurora switch id: own ID of the
-     *              aurora core. Must be a unique string
+     * switch_port: Port of the aurora switch
+     * id: own ID of the aurora core. Must be a unique string
      * remote_id: ID of the aurora core to connect to
      * user_to_remote: AXI stream to pass data into the aurora core
      * remote_to_user: AXI stream to read data from the aurora core
+     * batch_size: maximum number of beats sent in a single message
+     * flush_timeout_us: time in microseconds to wait for further beats
+     *                   before an incomplete batch is sent
+     * rx_fifo_depth: number of beats that fit into the RX FIFO
+     * rx_fifo_prog_full: RX FIFO fill level in beats that sends XOFF to
+     *                    the senders
+     * rx_fifo_prog_empty: RX FIFO fill level in beats that sends XON to
+     *                     the senders after an XOFF
+     * link_model: line rate, latency and error rates of the link to the
+     *             switch. By default, data is forwarded as fast as the
+     *             transport allows and without errors
+     * framing: transfer keep and last of every beat and count received
+     *          frames like a core that is built with USE_FRAMING
+     * direct: send data directly to the remote core if it registered with
+     *         the switch before the first beat is sent, and register this
+     *         core for direct data. Otherwise, data is routed by the switch
      */
-    AuroraEmuCore(std::string switch_address, int switch_port, std::string id,
-                  std::string remote_id,
-                  hlslib::Stream<data_stream_t> &user_to_remote,
-                  hlslib::Stream<data_stream_t> &remote_to_user)
-        : ctx(1),
-          to_switch(ctx, zmq::socket_type::push),
-          from_switch(ctx, zmq::socket_type::sub),
-          kill_socket(ctx, zmq::socket_type::pub),
-          user_to_remote(user_to_remote),
-          remote_to_user(remote_to_user),
-          id(id),
-          remote_id(remote_id) {
-        kill_socket.bind("inproc://kill_" + id);
-        to_switch.connect("tcp://" + switch_address + ":" +
-                          std::to_string(switch_port));
-        from_switch.connect("tcp://" + switch_address + ":" +
-                            std::to_string(switch_port + 1));
-        from_switch.set(zmq::sockopt::subscribe, id);
-        std::thread t1(&AuroraEmuCore::forward_from_remote, this);
-        std::thread t2(&AuroraEmuCore::forward_from_user, this);
-        recv_thread.swap(t1);
-        send_thread.swap(t2);
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(RECV_POLL_INTERVAL));
+    BasicAuroraEmuCore(std::string switch_address, int switch_port,
+                       std::string id, std::string remote_id,
+                       hlslib::Stream<T> &user_to_remote,
+                       hlslib::Stream<T> &remote_to_user,
+                       size_t batch_size = DEFAULT_BATCH_SIZE,
+                       int flush_timeout_us = DEFAULT_FLUSH_TIMEOUT,
+                       size_t rx_fifo_depth = DEFAULT_RX_FIFO_DEPTH,
+                       size_t rx_fifo_prog_full = DEFAULT_RX_FIFO_PROG_FULL,
+                       size_t rx_fifo_prog_empty = DEFAULT_RX_FIFO_PROG_EMPTY,
+                       AuroraEmuLinkModel link_model =
+                           AuroraEmuLinkModel::unlimited(),
+                       bool framing = false, bool direct = true)
+        : BasicAuroraEmuCore(nullptr, switch_address, switch_port, id,
+                             remote_id, user_to_remote, remote_to_user,
+                             batch_size, flush_timeout_us, rx_fifo_depth,
+                             rx_fifo_prog_full, rx_fifo_prog_empty,
+                             link_model, framing, direct) {}
+
+    /**
+     * Construct and connect a new aurora core that is forwarded by the
+     * workers of a shared runtime instead of its own threads. The runtime
+     * has to outlive the core. The remaining arguments are the same as
+     * above
+     */
+    BasicAuroraEmuCore(AuroraEmuRuntime &runtime, std::string switch_address,
+                       int switch_port, std::string id, std::string remote_id,
+                       hlslib::Stream<T> &user_to_remote,
+                       hlslib::Stream<T> &remote_to_user,
+                       size_t batch_size = DEFAULT_BATCH_SIZE,
+                       int flush_timeout_us = DEFAULT_FLUSH_TIMEOUT,
+                       size_t rx_fifo_depth = DEFAULT_RX_FIFO_DEPTH,
+                       size_t rx_fifo_prog_full = DEFAULT_RX_FIFO_PROG_FULL,
+                       size_t rx_fifo_prog_empty = DEFAULT_RX_FIFO_PROG_EMPTY,
+                       AuroraEmuLinkModel link_model =
+                           AuroraEmuLinkModel::unlimited(),
+                       bool framing = false, bool direct = true)
+        : BasicAuroraEmuCore(&runtime, switch_address, switch_port, id,
+                             remote_id, user_to_remote, remote_to_user,
+                             batch_size, flush_timeout_us, rx_fifo_depth,
+                             rx_fifo_prog_full, rx_fifo_prog_empty,
+                             link_model, framing, direct) {}
+
+    ~BasicAuroraEmuCore() { stop(); }
+
+    /**
+     * Wait until the switch acknowledged the connection of this core. Data
+     * sent to this core by other cores is not lost, even if it was sent
+     * before. The constructor already waits for the connection
+     *
+     * timeout_ms: maximum time to wait in milliseconds
+     *
+     * Returns false if the connection was not acknowledged in time
+     */
+    bool wait_until_connected(int timeout_ms = DEFAULT_CONNECT_TIMEOUT) {
+        std::unique_lock<std::mutex> lock(connected_mutex);
+        return connected_cv.wait_for(lock,
+                                     std::chrono::milliseconds(timeout_ms),
+                                     [this] { return connected; });
     }
 
-    ~AuroraEmuCore() {
-        // send kill signal to all threads
-        // and wait for them to join
-        zmq::message_t t(0);
-        kill_socket.send(t, zmq::send_flags::none);
-        if (recv_thread.joinable()) {
-            recv_thread.join();
-        }
-        if (send_thread.joinable()) {
-            send_thread.join();
+    /**
+     * Returns true if data to the remote core bypasses the switch. The path
+     * is chosen when the first batch is sent
+     */
+    bool is_direct() { return remote_direct; }
+
+    /**
+     * Number of beats currently buffered in the RX FIFO
+     */
+    size_t get_rx_fifo_fill_level() {
+        std::lock_guard<std::mutex> lock(rx_fifo_mutex);
+        return rx_fifo.size();
+    }
+
+    /**
+     * Number of XOFF messages sent because the RX FIFO was full
+     */
+    uint32_t get_xoff_count() {
+        return registers.read_register(
+            AuroraEmuRegisters::NFC_FULL_TRIGGER_COUNT);
+    }
+
+    /**
+     * Number of XON messages sent because the RX FIFO was drained
+     */
+    uint32_t get_xon_count() {
+        return registers.read_register(
+            AuroraEmuRegisters::NFC_EMPTY_TRIGGER_COUNT);
+    }
+
+    /**
+     * Number of beats received while the RX FIFO was full
+     */
+    uint32_t get_rx_overflow_count() {
+        return registers.read_register(
+            AuroraEmuRegisters::FIFO_RX_OVERFLOW_COUNT);
+    }
+
+    /**
+     * Register file of the core with the same layout as the hardware
+     * kernel. Can be used to construct an Aurora object in host/Aurora.hpp
+     */
+    AuroraEmuRegisters &get_registers() { return registers; }
+
+    /**
+     * Live statistics of the core. The queue depth is the fill level of
+     * the RX FIFO. The latency is measured from packing a batch until it
+     * arrives in the RX FIFO
+     */
+    AuroraEmuStats &get_stats() { return stats; }
+
+    /**
+     * Record all received data in a trace until set_trace() is called with
+     * nullptr. The trace has to outlive the recording
+     */
+    void set_trace(AuroraEmuTraceWriter *writer) {
+        if (writer && (writer->get_beat_bytes() != beat_bytes ||
+                       writer->has_framing() != framing)) {
+            throw std::invalid_argument(
+                "Beat format of the trace does not match core " + id);
         }
+        trace.store(writer, std::memory_order_release);
+    }
+
+    /**
+     * Write the IDs and the statistics of the core as JSON object
+     */
+    void write_stats_json(std::ostream &out) {
+        out << "{\"id\": ";
+        write_json_string(out, id);
+        out << ", \"remote_id\": ";
+        write_json_string(out, remote_id);
+        out << ", \"stats\": ";
+        stats.write_json(out);
+        out << "}";
     }
 };
+
+typedef BasicAuroraEmuCore<data_stream_t> AuroraEmuCore;
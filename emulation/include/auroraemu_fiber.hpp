@@ -0,0 +1,248 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <ucontext.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "auroraemu_runtime.hpp"
+#include "hlslib/xilinx/Stream.h"
+
+// stack size of a fiber. HLS kernels often keep large buffers on the stack
+const size_t DEFAULT_FIBER_STACK_BYTES = 1 << 20;
+
+/**
+ * Emulated HLS kernel that runs as a fiber on the workers of an
+ * AuroraEmuRuntime instead of on its own thread.
+ *
+ * The fiber is an AuroraEmuTask, so kernels and the cores they talk to are
+ * forwarded by the same workers. A fiber runs until it has to wait for a
+ * stream, e.g. in AuroraEmuStream::read(), and then returns control to the
+ * worker, which continues with the next task. A waiting fiber is only
+ * resumed after its stream became ready, so waiting kernels cost no more
+ * than a check of the stream.
+ *
+ * Scheduling is cooperative: a kernel that blocks its thread, e.g. by
+ * reading a plain hlslib::Stream, blocks all tasks of its worker.
+ */
+class AuroraEmuFiber : private AuroraEmuTask {
+   private:
+    AuroraEmuRuntime &runtime;
+    std::function<void()> kernel;
+    std::unique_ptr<char[]> stack;
+    ucontext_t context;
+    // context of the worker that resumed the fiber
+    ucontext_t caller;
+    // condition the fiber waits for, empty if the fiber can continue
+    std::function<bool()> ready;
+    bool progress;
+    bool returned;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool finished;
+
+    static AuroraEmuFiber *&current_fiber() {
+        static thread_local AuroraEmuFiber *fiber = nullptr;
+        return fiber;
+    }
+
+    // makecontext only passes int arguments, so the pointer to the fiber
+    // is split into two halves
+    static void entry(unsigned int high, unsigned int low) {
+        AuroraEmuFiber *fiber = reinterpret_cast<AuroraEmuFiber *>(
+            (static_cast<uintptr_t>(high) << 16 << 16) | low);
+        try {
+            fiber->kernel();
+        } catch (...) {
+            fiber->error = std::current_exception();
+        }
+        fiber->returned = true;
+        // returns to the worker via uc_link
+    }
+
+    bool poll() override {
+        if (returned || (ready && !ready())) {
+            return false;
+        }
+        ready = nullptr;
+        progress = false;
+        AuroraEmuFiber *previous = current_fiber();
+        current_fiber() = this;
+        swapcontext(&caller, &context);
+        current_fiber() = previous;
+        if (returned) {
+            // the stack is no longer used, so the fiber may be destroyed
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            cv.notify_all();
+            return true;
+        }
+        return progress;
+    }
+
+   public:
+    /**
+     * Create a fiber and schedule it on the runtime
+     *
+     * runtime: runtime whose workers execute the kernel. It has to outlive
+     *          the fiber
+     * kernel: function that is executed by the fiber, e.g. a lambda that
+     *         calls the HLS kernel with its arguments
+     * stack_bytes: size of the stack of the fiber
+     */
+    AuroraEmuFiber(AuroraEmuRuntime &runtime, std::function<void()> kernel,
+                   size_t stack_bytes = DEFAULT_FIBER_STACK_BYTES)
+        : runtime(runtime),
+          kernel(kernel),
+          stack(new char[stack_bytes]),
+          progress(false),
+          returned(false),
+          finished(false) {
+        if (getcontext(&context) != 0) {
+            throw std::runtime_error("Failed to create fiber context");
+        }
+        context.uc_stack.ss_sp = stack.get();
+        context.uc_stack.ss_size = stack_bytes;
+        context.uc_link = &caller;
+        uintptr_t self = reinterpret_cast<uintptr_t>(this);
+        makecontext(&context, reinterpret_cast<void (*)()>(&entry), 2,
+                    static_cast<unsigned int>(self >> 16 >> 16),
+                    static_cast<unsigned int>(self & 0xffffffff));
+        runtime.add(this);
+    }
+
+    /**
+     * Waits until the kernel returned
+     */
+    ~AuroraEmuFiber() {
+        wait_finished();
+        runtime.remove(this);
+    }
+
+    AuroraEmuFiber(const AuroraEmuFiber &) = delete;
+    AuroraEmuFiber &operator=(const AuroraEmuFiber &) = delete;
+
+    /**
+     * Wait until the kernel returned. Rethrows an exception that was thrown
+     * by the kernel. Must not be called from a fiber
+     */
+    void join() {
+        wait_finished();
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    bool is_finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished;
+    }
+
+    /**
+     * Returns the fiber that is executed by the calling thread or nullptr
+     * if the thread does not execute a fiber
+     */
+    static AuroraEmuFiber *current() { return current_fiber(); }
+
+    /**
+     * Suspend the calling fiber until condition returns true. The condition
+     * is checked by the worker, so it must not block. Returns immediately
+     * if the caller is not a fiber
+     */
+    static void wait_until(std::function<bool()> condition) {
+        AuroraEmuFiber *fiber = current();
+        if (fiber == nullptr) {
+            return;
+        }
+        if (!condition()) {
+            fiber->ready = condition;
+            swapcontext(&fiber->context, &fiber->caller);
+        }
+        fiber->progress = true;
+    }
+
+    /**
+     * Let the worker execute other tasks before the calling fiber continues
+     */
+    static void yield() {
+        AuroraEmuFiber *fiber = current();
+        if (fiber != nullptr) {
+            fiber->progress = true;
+            swapcontext(&fiber->context, &fiber->caller);
+        }
+    }
+
+   private:
+    void wait_finished() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return finished; });
+    }
+};
+
+/**
+ * Stream that suspends the calling fiber instead of blocking its thread.
+ *
+ * Kernels that run in an AuroraEmuFiber must take their streams as
+ * AuroraEmuStream&, e.g. with the STREAM macro of the example. The stream
+ * does not convert to hlslib::Stream, because read() and write() of
+ * hlslib::Stream would block the worker. get_stream() connects it to
+ * AuroraEmuCore or AuroraEmu. Outside of a fiber it blocks like
+ * hlslib::Stream. Each stream must have a single reader and a single writer.
+ */
+template <typename T>
+class AuroraEmuStream : private hlslib::Stream<T> {
+   public:
+    using hlslib::Stream<T>::empty;
+    using hlslib::Stream<T>::full;
+    using hlslib::Stream<T>::read_nb;
+    using hlslib::Stream<T>::write_nb;
+
+    AuroraEmuStream() : hlslib::Stream<T>() {}
+
+    explicit AuroraEmuStream(const char *name) : hlslib::Stream<T>(name) {}
+
+    explicit AuroraEmuStream(const std::string &name)
+        : hlslib::Stream<T>(name) {}
+
+    T read() {
+        AuroraEmuFiber::wait_until([this] { return !this->empty(); });
+        return hlslib::Stream<T>::read();
+    }
+
+    void write(const T &value) {
+        AuroraEmuFiber::wait_until([this] { return !this->full(); });
+        hlslib::Stream<T>::write(value);
+    }
+
+    /**
+     * Returns the underlying stream to connect an AuroraEmuCore or
+     * AuroraEmu, whose threads do not run in a fiber. Kernels must not
+     * access it
+     */
+    hlslib::Stream<T> &get_stream() { return *this; }
+};
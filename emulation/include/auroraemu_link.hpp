@@ -0,0 +1,314 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <ap_int.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// user data rate of the 4 lane 64b66b core: 4 x 25.78125 Gbit/s x 64 / 66
+const double DEFAULT_LINE_RATE_GBPS = 100.0;
+// number of bytes that may be sent back-to-back after the link was idle.
+// Matches one batch of DEFAULT_BATCH_SIZE beats
+const size_t DEFAULT_LINK_BURST_BYTES = 4096;
+
+/**
+ * Timing model of an Aurora link.
+ *
+ * The line rate is enforced with a token bucket: the sender calls pace()
+ * for every message and is put to sleep until the bucket holds enough
+ * tokens. The bucket is implemented as a virtual departure time of the
+ * next byte, so no background thread is required and sleeping for too long
+ * is compensated by later messages.
+ *
+ * The propagation latency is applied on the receiving side by an
+ * AuroraEmuDelayLine.
+ *
+ * Bit errors and corrupted frames can be injected into received beats with
+ * inject_errors(). Bit errors are placed with geometrically distributed
+ * distances, so the cost does not depend on the number of bits.
+ */
+class AuroraEmuLinkModel {
+   private:
+    typedef std::chrono::steady_clock clock;
+
+    double line_rate_gbps;
+    std::chrono::nanoseconds latency;
+    size_t frame_overhead_bytes;
+    std::chrono::nanoseconds burst_time;
+    // time at which all bytes passed to pace() have left the link
+    clock::time_point departure;
+
+    // error model
+    double bit_error_rate;
+    double frame_error_rate;
+    std::mt19937_64 rng;
+    // number of correct bits before the next bit error
+    uint64_t bits_until_error;
+
+    uint64_t next_bit_error() {
+        std::geometric_distribution<uint64_t> distance(bit_error_rate);
+        return distance(rng);
+    }
+
+    static void check_rate(double rate) {
+        if (rate < 0 || rate >= 1) {
+            throw std::invalid_argument("Error rates must be in [0, 1)");
+        }
+    }
+
+    std::chrono::nanoseconds transmission_time(size_t bytes) {
+        // 1 Gbit/s transmits one bit per nanosecond
+        return std::chrono::nanoseconds(
+            static_cast<int64_t>(bytes * 8 / line_rate_gbps));
+    }
+
+   public:
+    /**
+     * Create a link model
+     *
+     * line_rate_gbps: user data rate in Gbit/s. 0 disables rate limiting
+     * latency_ns: propagation latency of the link in nanoseconds
+     * frame_overhead_bytes: bytes transmitted in addition to the payload
+     *                       for every frame
+     * burst_bytes: size of the token bucket in bytes
+     */
+    AuroraEmuLinkModel(double line_rate_gbps = DEFAULT_LINE_RATE_GBPS,
+                       uint64_t latency_ns = 0,
+                       size_t frame_overhead_bytes = 0,
+                       size_t burst_bytes = DEFAULT_LINK_BURST_BYTES)
+        : line_rate_gbps(line_rate_gbps),
+          latency(latency_ns),
+          frame_overhead_bytes(frame_overhead_bytes),
+          burst_time(0),
+          departure(clock::now()),
+          bit_error_rate(0),
+          frame_error_rate(0),
+          bits_until_error(0) {
+        if (line_rate_gbps < 0) {
+            throw std::invalid_argument("Line rate must not be negative");
+        }
+        if (is_rate_limited()) {
+            burst_time = transmission_time(burst_bytes);
+        }
+    }
+
+    /**
+     * Link model without rate limit and latency, which forwards data as
+     * fast as the transport allows
+     */
+    static AuroraEmuLinkModel unlimited() { return AuroraEmuLinkModel(0); }
+
+    bool is_rate_limited() const { return line_rate_gbps > 0; }
+
+    bool has_latency() const { return latency.count() > 0; }
+
+    std::chrono::nanoseconds get_latency() const { return latency; }
+
+    double get_line_rate_gbps() const { return line_rate_gbps; }
+
+    size_t get_frame_overhead_bytes() const { return frame_overhead_bytes; }
+
+    /**
+     * Set the probability of a bit flip for every received bit
+     */
+    void set_bit_error_rate(double rate) {
+        check_rate(rate);
+        bit_error_rate = rate;
+        if (rate > 0) {
+            bits_until_error = next_bit_error();
+        }
+    }
+
+    /**
+     * Set the probability that a received frame is corrupted by a single
+     * bit flip in its last beat. Without framing, every beat is considered
+     * a frame
+     */
+    void set_frame_error_rate(double rate) {
+        check_rate(rate);
+        frame_error_rate = rate;
+    }
+
+    /**
+     * Seed the random number generator of the error model to get
+     * reproducible error patterns
+     */
+    void set_seed(uint64_t seed) {
+        rng.seed(seed);
+        if (bit_error_rate > 0) {
+            bits_until_error = next_bit_error();
+        }
+    }
+
+    bool has_errors() const {
+        return bit_error_rate > 0 || frame_error_rate > 0;
+    }
+
+    /**
+     * Apply the error model to a received beat
+     *
+     * beat: data of the beat, modified in place
+     * last: beat ends a frame
+     *
+     * Returns true if at least one bit was flipped
+     */
+    template <int W>
+    bool inject_errors(ap_uint<W> &beat, bool last) {
+        bool corrupted = false;
+        if (bit_error_rate > 0) {
+            uint64_t position = 0;
+            while (position + bits_until_error < W) {
+                position += bits_until_error;
+                beat ^= ap_uint<W>(1) << static_cast<int>(position);
+                corrupted = true;
+                position++;
+                bits_until_error = next_bit_error();
+            }
+            bits_until_error -= W - position;
+        }
+        if (last && frame_error_rate > 0) {
+            std::bernoulli_distribution frame_error(frame_error_rate);
+            if (frame_error(rng)) {
+                std::uniform_int_distribution<int> bit(0, W - 1);
+                beat ^= ap_uint<W>(1) << bit(rng);
+                corrupted = true;
+            }
+        }
+        return corrupted;
+    }
+
+    /**
+     * Block the sender until bytes payload bytes in the given number of
+     * frames may be sent according to the line rate. Sleeps instead of
+     * busy-waiting
+     */
+    void pace(size_t bytes, size_t frames = 1) {
+        if (!is_rate_limited()) {
+            return;
+        }
+        clock::time_point now = clock::now();
+        if (departure < now) {
+            departure = now;
+        }
+        departure += transmission_time(bytes + frames * frame_overhead_bytes);
+        if (departure - burst_time > now) {
+            std::this_thread::sleep_until(departure - burst_time);
+        }
+    }
+};
+
+/**
+ * Queue that holds received messages for the propagation latency of the
+ * link. Messages are stamped with their arrival time on push() and are
+ * returned by pop() in order once the latency has passed. The buffers of
+ * returned messages are reused for later messages.
+ */
+class AuroraEmuDelayLine {
+   private:
+    typedef std::chrono::steady_clock clock;
+
+    std::chrono::nanoseconds latency;
+    std::deque<std::pair<clock::time_point, std::vector<char>>> messages;
+    // buffers of messages that were already returned
+    std::vector<std::vector<char>> spare;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool closed;
+
+    // has to be called with the mutex held. The previous buffer of payload
+    // is kept for later messages
+    void take_front(std::vector<char> &payload) {
+        payload.swap(messages.front().second);
+        spare.push_back(std::move(messages.front().second));
+        messages.pop_front();
+    }
+
+   public:
+    explicit AuroraEmuDelayLine(std::chrono::nanoseconds latency)
+        : latency(latency), closed(false) {}
+
+    void push(const void *payload, size_t bytes) {
+        clock::time_point ready = clock::now() + latency;
+        const char *begin = static_cast<const char *>(payload);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<char> buffer;
+            if (!spare.empty()) {
+                buffer.swap(spare.back());
+                spare.pop_back();
+            }
+            buffer.assign(begin, begin + bytes);
+            messages.emplace_back(ready, std::move(buffer));
+        }
+        cv.notify_one();
+    }
+
+    /**
+     * Wait until the oldest message has passed the link and move it into
+     * payload. Returns false if the delay line was closed
+     */
+    bool pop(std::vector<char> &payload) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (closed) {
+                return false;
+            }
+            if (messages.empty()) {
+                cv.wait(lock);
+            } else if (clock::now() < messages.front().first) {
+                cv.wait_until(lock, messages.front().first);
+            } else {
+                take_front(payload);
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Move the oldest message into payload if it has already passed the
+     * link. Never blocks
+     */
+    bool try_pop(std::vector<char> &payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || messages.empty() ||
+            clock::now() < messages.front().first) {
+            return false;
+        }
+        take_front(payload);
+        return true;
+    }
+
+    /**
+     * Wake up and terminate all threads waiting in pop()
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
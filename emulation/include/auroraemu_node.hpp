@@ -0,0 +1,263 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "auroraemu.hpp"
+
+// number of FPGAs in a node of the cluster
+const uint32_t DEFAULT_NODE_DEVICES = 3;
+
+/**
+ * QSFP port of an FPGA in the cluster, written as n00:acl0:ch1 like in the
+ * link lists of changeFPGAlinksXilinx. The channel is the instance of the
+ * aurora_flow kernel that is connected to the port
+ */
+struct AuroraEmuPort {
+    uint32_t node;
+    uint32_t device;
+    uint32_t channel;
+
+    bool operator==(const AuroraEmuPort &other) const {
+        return node == other.node && device == other.device &&
+               channel == other.channel;
+    }
+
+    bool operator!=(const AuroraEmuPort &other) const {
+        return !(*this == other);
+    }
+
+    /**
+     * ID of the emulated core of the port
+     */
+    std::string to_string() const {
+        char id[64];
+        std::snprintf(id, sizeof(id), "n%02u:acl%u:ch%u", node, device,
+                      channel);
+        return id;
+    }
+
+    static AuroraEmuPort parse(const std::string &port) {
+        AuroraEmuPort p;
+        int length = 0;
+        if (std::sscanf(port.c_str(), "n%u:acl%u:ch%u%n", &p.node, &p.device,
+                        &p.channel, &length) != 3 ||
+            static_cast<size_t>(length) != port.size()) {
+            throw std::invalid_argument("Invalid FPGA port " + port);
+        }
+        return p;
+    }
+};
+
+/**
+ * Bidirectional link between two QSFP ports
+ */
+typedef std::pair<AuroraEmuPort, AuroraEmuPort> AuroraEmuLink;
+
+/**
+ * Parse a link list in the syntax of changeFPGAlinksXilinx, e.g.
+ * "--fpgalink=n00:acl0:ch1-n00:acl1:ch0 --fpgalink=n00:acl1:ch1-n00:acl0:ch0".
+ * Links are separated by whitespace and the --fpgalink= prefix is optional
+ */
+inline std::vector<AuroraEmuLink> parse_fpga_links(const std::string &links) {
+    static const std::string prefix = "--fpgalink=";
+    std::vector<AuroraEmuLink> result;
+    std::istringstream in(links);
+    std::string link;
+    while (in >> link) {
+        if (link.compare(0, prefix.size(), prefix) == 0) {
+            link = link.substr(prefix.size());
+        }
+        size_t separator = link.find('-');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("Invalid FPGA link " + link);
+        }
+        result.emplace_back(AuroraEmuPort::parse(link.substr(0, separator)),
+                            AuroraEmuPort::parse(link.substr(separator + 1)));
+    }
+    return result;
+}
+
+/**
+ * Emulated node of the cluster with several FPGAs, each with the two
+ * aurora_flow kernels of the QSFP ports.
+ *
+ * The node creates a core for every port of its FPGAs that is part of a
+ * link and connects it to the port at the other end of the link. Links
+ * between two other nodes are ignored, so all nodes of an emulated cluster
+ * can be created from the same link list, e.g. in different processes that
+ * share a switch. Ports without a link have streams but no core.
+ *
+ * The streams of a port are the tx_axis and rx_axis of its aurora_flow
+ * kernel and are handed to the emulated HLS kernels of the FPGA.
+ */
+template <typename T>
+class BasicAuroraEmuNode {
+   public:
+    enum : uint32_t { NUM_CHANNELS = 2 };
+
+   private:
+    uint32_t node;
+    uint32_t num_devices;
+    // declared before the cores, so they are destroyed after them
+    std::vector<std::unique_ptr<hlslib::Stream<T>>> tx_streams;
+    std::vector<std::unique_ptr<hlslib::Stream<T>>> rx_streams;
+    std::vector<std::unique_ptr<BasicAuroraEmuCore<T>>> cores;
+
+    size_t index(uint32_t device, uint32_t channel) const {
+        if (device >= num_devices || channel >= NUM_CHANNELS) {
+            throw std::out_of_range("Port acl" + std::to_string(device) +
+                                    ":ch" + std::to_string(channel) +
+                                    " is not part of the node");
+        }
+        return device * NUM_CHANNELS + channel;
+    }
+
+    AuroraEmuPort port(size_t index) const {
+        return AuroraEmuPort{node, static_cast<uint32_t>(index / NUM_CHANNELS),
+                             static_cast<uint32_t>(index % NUM_CHANNELS)};
+    }
+
+    bool is_local(const AuroraEmuPort &port) const { return port.node == node; }
+
+    // ID of the remote core of every local port, empty if the port has no
+    // link. All links are checked before any core is created
+    void add_remote(std::vector<std::string> &remote_ids,
+                    const AuroraEmuPort &port, const AuroraEmuPort &remote) {
+        if (port.device >= num_devices || port.channel >= NUM_CHANNELS) {
+            throw std::invalid_argument("Port " + port.to_string() +
+                                        " does not exist");
+        }
+        size_t i = index(port.device, port.channel);
+        if (!remote_ids[i].empty()) {
+            throw std::invalid_argument("Port " + port.to_string() +
+                                        " is part of several links");
+        }
+        remote_ids[i] = remote.to_string();
+    }
+
+   public:
+    /**
+     * Create the cores of a node and connect them to a switch
+     *
+     * switch_address: IP address or name of the host of the switch
+     * switch_port: port of the switch
+     * links: links of the cluster, e.g. from parse_fpga_links()
+     * node: number of this node in the link list
+     * num_devices: number of FPGAs of the node
+     * link_model: line rate, latency and error rates of all links
+     * framing: the cores transfer keep and last
+     */
+    BasicAuroraEmuNode(std::string switch_address, int switch_port,
+                       const std::vector<AuroraEmuLink> &links,
+                       uint32_t node = 0,
+                       uint32_t num_devices = DEFAULT_NODE_DEVICES,
+                       AuroraEmuLinkModel link_model =
+                           AuroraEmuLinkModel::unlimited(),
+                       bool framing = false)
+        : node(node), num_devices(num_devices) {
+        for (uint32_t i = 0; i < num_devices * NUM_CHANNELS; i++) {
+            std::string name = port(i).to_string();
+            tx_streams.emplace_back(new hlslib::Stream<T>(name + ":tx"));
+            rx_streams.emplace_back(new hlslib::Stream<T>(name + ":rx"));
+        }
+        std::vector<std::string> remote_ids(num_devices * NUM_CHANNELS);
+        for (auto &link : links) {
+            if (is_local(link.first)) {
+                add_remote(remote_ids, link.first, link.second);
+            }
+            // a loopback cable connects a port with itself
+            if (is_local(link.second) && link.second != link.first) {
+                add_remote(remote_ids, link.second, link.first);
+            }
+        }
+        cores.resize(num_devices * NUM_CHANNELS);
+        for (size_t i = 0; i < cores.size(); i++) {
+            if (remote_ids[i].empty()) {
+                continue;
+            }
+            cores[i].reset(new BasicAuroraEmuCore<T>(
+                switch_address, switch_port, port(i).to_string(), remote_ids[i],
+                *tx_streams[i], *rx_streams[i], DEFAULT_BATCH_SIZE,
+                DEFAULT_FLUSH_TIMEOUT, DEFAULT_RX_FIFO_DEPTH,
+                DEFAULT_RX_FIFO_PROG_FULL, DEFAULT_RX_FIFO_PROG_EMPTY,
+                link_model, framing));
+        }
+    }
+
+    /**
+     * Create a node from a link list in the syntax of changeFPGAlinksXilinx
+     */
+    BasicAuroraEmuNode(std::string switch_address, int switch_port,
+                       const std::string &links, uint32_t node = 0,
+                       uint32_t num_devices = DEFAULT_NODE_DEVICES,
+                       AuroraEmuLinkModel link_model =
+                           AuroraEmuLinkModel::unlimited(),
+                       bool framing = false)
+        : BasicAuroraEmuNode(switch_address, switch_port,
+                             parse_fpga_links(links), node, num_devices,
+                             link_model, framing) {}
+
+    BasicAuroraEmuNode(const BasicAuroraEmuNode &) = delete;
+    BasicAuroraEmuNode &operator=(const BasicAuroraEmuNode &) = delete;
+
+    uint32_t get_node() const { return node; }
+
+    uint32_t get_num_devices() const { return num_devices; }
+
+    /**
+     * Stream into the core of a port, connected to tx_axis of its
+     * aurora_flow kernel
+     */
+    hlslib::Stream<T> &tx(uint32_t device, uint32_t channel) {
+        return *tx_streams[index(device, channel)];
+    }
+
+    /**
+     * Stream out of the core of a port, connected to rx_axis of its
+     * aurora_flow kernel
+     */
+    hlslib::Stream<T> &rx(uint32_t device, uint32_t channel) {
+        return *rx_streams[index(device, channel)];
+    }
+
+    bool is_connected(uint32_t device, uint32_t channel) {
+        return static_cast<bool>(cores[index(device, channel)]);
+    }
+
+    /**
+     * Core of a connected port, e.g. to read its statistics
+     */
+    BasicAuroraEmuCore<T> &get_core(uint32_t device, uint32_t channel) {
+        size_t i = index(device, channel);
+        if (!cores[i]) {
+            throw std::runtime_error(
+                "Port " + AuroraEmuPort{node, device, channel}.to_string() +
+                " is not connected");
+        }
+        return *cores[i];
+    }
+};
+
+typedef BasicAuroraEmuNode<data_stream_t> AuroraEmuNode;
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <zmq.hpp>
+
+// number of buffers that are allocated when a pool is created
+const size_t DEFAULT_POOL_BUFFERS = 16;
+
+/**
+ * Pool of fixed-size buffers for zero-copy ZMQ messages.
+ *
+ * message() wraps a buffer of the pool into a message without copying it.
+ * ZMQ returns the buffer to the pool as soon as the message was sent, which
+ * may happen on an I/O thread and after the pool was destroyed, e.g. if the
+ * context of a runtime keeps the message. The buffers are therefore owned
+ * by a shared state that is freed together with the last buffer.
+ *
+ * The pool grows if all buffers are in flight and keeps the new buffers,
+ * so no buffers are allocated once the number of messages in flight is
+ * stable.
+ */
+class AuroraEmuBufferPool {
+   private:
+    struct State {
+        std::mutex mutex;
+        std::vector<char *> free;
+        size_t buffer_bytes;
+        // buffers that are owned by messages
+        size_t in_flight;
+        // the pool was destroyed
+        bool closed;
+    };
+
+    State *state;
+
+    // free function of the ZMQ messages
+    static void release(void *buffer, void *hint) {
+        State *state = static_cast<State *>(hint);
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->in_flight--;
+            if (!state->closed) {
+                state->free.push_back(static_cast<char *>(buffer));
+                return;
+            }
+            delete[] static_cast<char *>(buffer);
+            last = state->in_flight == 0;
+        }
+        if (last) {
+            delete state;
+        }
+    }
+
+   public:
+    /**
+     * Create a pool
+     *
+     * buffer_bytes: size of every buffer and maximum size of a message
+     * buffers: number of buffers that are allocated in advance
+     */
+    explicit AuroraEmuBufferPool(size_t buffer_bytes,
+                                 size_t buffers = DEFAULT_POOL_BUFFERS)
+        : state(new State()) {
+        state->buffer_bytes = buffer_bytes;
+        state->in_flight = 0;
+        state->closed = false;
+        for (size_t i = 0; i < buffers; i++) {
+            state->free.push_back(new char[buffer_bytes]);
+        }
+    }
+
+    /**
+     * Free all buffers that are not in flight. The others are freed when
+     * ZMQ releases their messages
+     */
+    ~AuroraEmuBufferPool() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (auto buffer : state->free) {
+                delete[] buffer;
+            }
+            state->free.clear();
+            state->closed = true;
+            last = state->in_flight == 0;
+        }
+        if (last) {
+            delete state;
+        }
+    }
+
+    AuroraEmuBufferPool(const AuroraEmuBufferPool &) = delete;
+    AuroraEmuBufferPool &operator=(const AuroraEmuBufferPool &) = delete;
+
+    size_t get_buffer_bytes() const { return state->buffer_bytes; }
+
+    size_t get_num_buffers() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->free.size() + state->in_flight;
+    }
+
+    /**
+     * Rebuild msg with a buffer of the pool that holds bytes bytes and
+     * return the buffer, so it can be filled before the message is sent.
+     * bytes must not exceed the buffer size of the pool
+     */
+    char *message(zmq::message_t &msg, size_t bytes) {
+        char *buffer;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->free.empty()) {
+                buffer = new char[state->buffer_bytes];
+            } else {
+                buffer = state->free.back();
+                state->free.pop_back();
+            }
+            state->in_flight++;
+        }
+        msg.rebuild(buffer, bytes, &AuroraEmuBufferPool::release, state);
+        return buffer;
+    }
+};
+
+/**
+ * FIFO of beats in a ring buffer that doubles its capacity when it is full
+ * and never shrinks, so a FIFO with a stable fill level does not allocate
+ * memory. Unlike a std::deque, it does not allocate and free blocks while
+ * beats pass through it
+ */
+template <typename T>
+class AuroraEmuFifo {
+   private:
+    std::vector<T> slots;
+    size_t head;
+    size_t count;
+
+    void grow() {
+        std::vector<T> larger(slots.empty() ? 64 : slots.size() * 2);
+        for (size_t i = 0; i < count; i++) {
+            larger[i] = slots[(head + i) % slots.size()];
+        }
+        slots.swap(larger);
+        head = 0;
+    }
+
+   public:
+    explicit AuroraEmuFifo(size_t capacity = 0)
+        : slots(capacity), head(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+
+    size_t size() const { return count; }
+
+    void push_back(const T &beat) {
+        if (count == slots.size()) {
+            grow();
+        }
+        slots[(head + count) % slots.size()] = beat;
+        count++;
+    }
+
+    T &front() { return slots[head]; }
+
+    void pop_front() {
+        head = (head + 1) % slots.size();
+        count--;
+    }
+};
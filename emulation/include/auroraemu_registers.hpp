@@ -0,0 +1,158 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Model of the control register file of the aurora_flow kernel. The register
+ * offsets match rtl/aurora_flow_control_s_axi.v, so the register file can be
+ * read with the same addresses that are used in host/Aurora.hpp.
+ *
+ * Counters are updated by the forwarding threads of the emulator with relaxed
+ * atomics. They are only read for statistics, so no ordering with the data
+ * is required.
+ */
+class AuroraEmuRegisters {
+   public:
+    enum : uint32_t {
+        // control s axi addresses
+        CORE_RESET = 0x10,
+        COUNTER_RESET = 0x14,
+        CONFIGURATION = 0x18,
+        FIFO_THRESHOLDS = 0x1c,
+        CORE_STATUS = 0x20,
+        STATUS_NOT_OK_COUNT = 0x24,
+        FIFO_STATUS = 0x28,
+        FIFO_RX_OVERFLOW_COUNT = 0x2c,
+        FIFO_TX_OVERFLOW_COUNT = 0x30,
+        NFC_FULL_TRIGGER_COUNT = 0x34,
+        NFC_EMPTY_TRIGGER_COUNT = 0x38,
+        NFC_LATENCY_COUNT = 0x3c,
+        TX_COUNT = 0x40,
+        RX_COUNT = 0x44,
+        FRAMES_RECEIVED = 0x7c,
+        FRAMES_WITH_ERRORS = 0x80,
+
+        // core status of a healthy link: all lanes powered and up, PLL locked
+        // and channel up
+        CORE_STATUS_OK = 0x000011ff,
+
+        // fifo status bits
+        FIFO_RX_PROG_EMPTY = 0x00000010,
+        FIFO_RX_PROG_FULL = 0x00000040,
+
+        // first counter register. All registers from here on are cleared by a
+        // counter reset
+        FIRST_COUNTER = STATUS_NOT_OK_COUNT,
+        NUM_REGISTERS = FRAMES_WITH_ERRORS / 4 + 1
+    };
+
+   private:
+    std::atomic<uint32_t> registers[NUM_REGISTERS];
+
+    std::atomic<uint32_t> &reg(uint32_t offset) {
+        return registers[(offset / 4) % NUM_REGISTERS];
+    }
+
+    static uint32_t log2(uint32_t value) {
+        uint32_t result = 0;
+        while ((1u << result) < value) {
+            result++;
+        }
+        return result;
+    }
+
+   public:
+    /**
+     * Create a register file with the configuration of a hardware core
+     *
+     * fifo_width: width of the user interface in bytes
+     * fifo_depth: depth of the RX FIFO in beats
+     * prog_full: RX FIFO fill level at which XOFF is sent
+     * prog_empty: RX FIFO fill level at which XON is sent
+     * has_framing: core is configured with tlast and tkeep
+     */
+    AuroraEmuRegisters(uint32_t fifo_width, uint32_t fifo_depth,
+                       uint32_t prog_full, uint32_t prog_empty,
+                       bool has_framing = false) {
+        for (uint32_t i = 0; i < NUM_REGISTERS; i++) {
+            registers[i].store(0, std::memory_order_relaxed);
+        }
+        // insertion loss of 8 dB and LPM equalization, as configured in the
+        // Makefile
+        uint32_t configuration = (8u << 17) | (1u << 15) |
+                                 (log2(fifo_depth) << 11) |
+                                 ((fifo_width & 0x1ff) << 2);
+        if (has_framing) {
+            configuration |= 0x3;
+        }
+        set(CONFIGURATION, configuration);
+        set(FIFO_THRESHOLDS, (prog_full << 16) | (prog_empty & 0xffff));
+        set(CORE_STATUS, CORE_STATUS_OK);
+        set(FIFO_STATUS, FIFO_RX_PROG_EMPTY);
+    }
+
+    AuroraEmuRegisters(const AuroraEmuRegisters &) = delete;
+    AuroraEmuRegisters &operator=(const AuroraEmuRegisters &) = delete;
+
+    /**
+     * Read a register, same interface as xrt::ip
+     */
+    uint32_t read_register(uint32_t offset) {
+        return reg(offset).load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Write a register, same interface as xrt::ip. Only the reset registers
+     * are writable. Writing a non-zero value to either of them clears all
+     * counters
+     */
+    void write_register(uint32_t offset, uint32_t value) {
+        if ((offset == COUNTER_RESET || offset == CORE_RESET) && value) {
+            reset_counters();
+        }
+    }
+
+    void reset_counters() {
+        for (uint32_t i = FIRST_COUNTER / 4; i < NUM_REGISTERS; i++) {
+            if (i != FIFO_STATUS / 4) {
+                registers[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void add(uint32_t offset, uint32_t value) {
+        reg(offset).fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void set(uint32_t offset, uint32_t value) {
+        reg(offset).store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * Keep the maximum of the current register value and value
+     */
+    void max(uint32_t offset, uint32_t value) {
+        std::atomic<uint32_t> &r = reg(offset);
+        uint32_t current = r.load(std::memory_order_relaxed);
+        while (current < value &&
+               !r.compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+        }
+    }
+};
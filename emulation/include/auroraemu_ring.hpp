@@ -0,0 +1,236 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// depth of the RX FIFO of the default hardware configuration
+// (RX_FIFO_SIZE / FIFO_WIDTH in the Makefile)
+const size_t DEFAULT_RING_DEPTH = 1024;
+
+/**
+ * Control block at the start of a shared memory ring. Producer and consumer
+ * indices are placed in separate cache lines to avoid false sharing.
+ */
+struct AuroraEmuRingHeader {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t depth;
+    uint64_t beat_bytes;
+};
+
+/**
+ * Lock-free single producer, single consumer ring buffer of beats in a
+ * POSIX shared memory region. The ring can be used by threads of the same
+ * process or by two processes on the same host.
+ *
+ * Every slot holds one beat in the wire format of pack_batch() without
+ * framing. The producer writes beats directly into the ring using claim() and
+ * publish(). The consumer reads them in place using peek() and release(),
+ * so no intermediate copies are made.
+ */
+class AuroraEmuRing {
+   private:
+    std::string name;
+    AuroraEmuRingHeader *header;
+    char *slots;
+    size_t mapped_size;
+    uint64_t mask;
+    bool owner;
+
+    static size_t region_size(size_t depth, size_t beat_bytes) {
+        return sizeof(AuroraEmuRingHeader) + depth * beat_bytes;
+    }
+
+    void map(int fd, size_t size) {
+        void *region =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (region == MAP_FAILED) {
+            throw std::runtime_error("Could not map shared memory " + name);
+        }
+        mapped_size = size;
+        header = static_cast<AuroraEmuRingHeader *>(region);
+        slots = reinterpret_cast<char *>(header + 1);
+    }
+
+   public:
+    /**
+     * Create a new ring as producer
+     *
+     * name: name of the shared memory object. Must start with a slash and
+     *       must not contain further slashes
+     * depth: number of beats that fit into the ring. Rounded up to the next
+     *        power of two
+     * beat_bytes: size of a beat in bytes
+     */
+    AuroraEmuRing(std::string name, size_t depth, size_t beat_bytes = 64)
+        : name(name), owner(true) {
+        size_t d = 1;
+        while (d < depth) {
+            d <<= 1;
+        }
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, region_size(d, beat_bytes)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Could not create shared memory " + name);
+        }
+        map(fd, region_size(d, beat_bytes));
+        new (&header->head) std::atomic<uint64_t>(0);
+        new (&header->tail) std::atomic<uint64_t>(0);
+        header->depth = d;
+        header->beat_bytes = beat_bytes;
+        mask = d - 1;
+    }
+
+    /**
+     * Attach to an existing ring as consumer
+     *
+     * name: name of the shared memory object that was used by the producer
+     */
+    explicit AuroraEmuRing(std::string name) : name(name), owner(false) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open shared memory " + name);
+        }
+        off_t size = lseek(fd, 0, SEEK_END);
+        if (size < static_cast<off_t>(sizeof(AuroraEmuRingHeader))) {
+            close(fd);
+            throw std::runtime_error("Shared memory " + name +
+                                     " is not an Aurora ring");
+        }
+        map(fd, size);
+        mask = header->depth - 1;
+    }
+
+    ~AuroraEmuRing() {
+        munmap(header, mapped_size);
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    AuroraEmuRing(const AuroraEmuRing &) = delete;
+    AuroraEmuRing &operator=(const AuroraEmuRing &) = delete;
+
+    size_t depth() { return header->depth; }
+
+    size_t beat_bytes() { return header->beat_bytes; }
+
+    /**
+     * Get a pointer to the free slots following the current write position.
+     * count is set to the number of contiguous free slots, which may be 0
+     */
+    char *claim(size_t &count) {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t free_slots = header->depth - (head - tail);
+        size_t until_wrap = header->depth - (head & mask);
+        count = free_slots < until_wrap ? free_slots : until_wrap;
+        return slots + (head & mask) * header->beat_bytes;
+    }
+
+    /**
+     * Make count beats written to the claimed slots visible to the consumer
+     */
+    void publish(size_t count) {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        header->head.store(head + count, std::memory_order_release);
+    }
+
+    /**
+     * Get a pointer to the beats following the current read position.
+     * count is set to the number of contiguous readable beats, which may be 0
+     */
+    const char *peek(size_t &count) {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        size_t until_wrap = header->depth - (tail & mask);
+        count = (head - tail) < until_wrap ? (head - tail) : until_wrap;
+        return slots + (tail & mask) * header->beat_bytes;
+    }
+
+    /**
+     * Free count beats that were read from the ring
+     */
+    void release(size_t count) {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        header->tail.store(tail + count, std::memory_order_release);
+    }
+};
+
+/**
+ * Wait strategy for ring buffers without notification mechanism.
+ * Spins and yields first and then backs off with increasing sleep times, so
+ * active links have low latency while idle links use little CPU time.
+ */
+class AuroraEmuBackoff {
+   private:
+    unsigned rounds = 0;
+    unsigned max_sleep_us;
+
+    std::chrono::microseconds next_sleep() {
+        unsigned shift = (rounds - 64) < 20 ? (rounds - 64) : 20;
+        return std::chrono::microseconds(
+            std::min(1u << shift, max_sleep_us));
+    }
+
+   public:
+    /**
+     * max_sleep_us: longest sleep between two checks. The operating system
+     * may sleep longer, e.g. by the timer slack of about 50 us on Linux
+     */
+    explicit AuroraEmuBackoff(unsigned max_sleep_us = 1024)
+        : max_sleep_us(max_sleep_us) {}
+
+    void wait() {
+        if (rounds < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(next_sleep());
+        }
+        rounds++;
+    }
+
+    /**
+     * Wait like wait(), but never sleep past deadline
+     */
+    void wait(std::chrono::steady_clock::time_point deadline) {
+        if (rounds < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_until(std::min(
+                deadline, std::chrono::steady_clock::now() + next_sleep()));
+        }
+        rounds++;
+    }
+
+    void reset() { rounds = 0; }
+};
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+
+#include "auroraemu_ring.hpp"
+
+/**
+ * Unit of work that is executed by the workers of an AuroraEmuRuntime
+ */
+class AuroraEmuTask {
+   public:
+    virtual ~AuroraEmuTask() {}
+
+    /**
+     * Forward the data that is available without blocking.
+     * Returns true if any data was forwarded
+     */
+    virtual bool poll() = 0;
+};
+
+/**
+ * Shared runtime for many emulated cores in one process.
+ *
+ * All cores that are registered with the runtime share a single ZMQ context
+ * and are polled by a fixed number of worker threads, so the number of
+ * threads depends on the host and not on the number of emulated cores.
+ * Every task is assigned to a single worker, so the sockets of a task are
+ * only used by one thread. Idle workers back off like the shm transport.
+ */
+class AuroraEmuRuntime {
+   private:
+    struct Worker {
+        std::mutex mutex;
+        std::vector<AuroraEmuTask *> tasks;
+        std::thread thread;
+    };
+
+    zmq::context_t ctx;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running;
+
+    void run(Worker &worker) {
+        AuroraEmuBackoff backoff;
+        while (running) {
+            bool active = false;
+            {
+                // tasks can only be removed between two rounds
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                for (auto task : worker.tasks) {
+                    active |= task->poll();
+                }
+            }
+            if (active) {
+                backoff.reset();
+            } else {
+                backoff.wait();
+            }
+        }
+    }
+
+   public:
+    /**
+     * Create a runtime and start the workers
+     *
+     * num_workers: number of threads that forward data. Defaults to the
+     *              number of hardware threads of the host
+     * io_threads: number of ZMQ I/O threads of the shared context
+     */
+    explicit AuroraEmuRuntime(size_t num_workers = 0, int io_threads = 1)
+        : ctx(io_threads), running(true) {
+        if (num_workers == 0) {
+            num_workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < num_workers; i++) {
+            workers.emplace_back(new Worker());
+        }
+        for (auto &worker : workers) {
+            std::thread t(&AuroraEmuRuntime::run, this, std::ref(*worker));
+            worker->thread.swap(t);
+        }
+    }
+
+    ~AuroraEmuRuntime() {
+        running = false;
+        for (auto &worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    AuroraEmuRuntime(const AuroraEmuRuntime &) = delete;
+    AuroraEmuRuntime &operator=(const AuroraEmuRuntime &) = delete;
+
+    zmq::context_t &context() { return ctx; }
+
+    size_t get_num_workers() { return workers.size(); }
+
+    /**
+     * Assign a task to the worker with the fewest tasks
+     */
+    void add(AuroraEmuTask *task) {
+        Worker *least = workers.front().get();
+        size_t least_tasks = SIZE_MAX;
+        for (auto &worker : workers) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            if (worker->tasks.size() < least_tasks) {
+                least = worker.get();
+                least_tasks = worker->tasks.size();
+            }
+        }
+        std::lock_guard<std::mutex> lock(least->mutex);
+        least->tasks.push_back(task);
+    }
+
+    /**
+     * Remove a task. Returns after the task was polled for the last time
+     */
+    void remove(AuroraEmuTask *task) {
+        for (auto &worker : workers) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->tasks.erase(
+                std::remove(worker->tasks.begin(), worker->tasks.end(), task),
+                worker->tasks.end());
+        }
+    }
+};
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#include "auroraemu.hpp"
+
+/**
+ * Parameters of a simulated link. The defaults match the default hardware
+ * build with a consumer that keeps up with the line rate
+ */
+struct AuroraEmuSimConfig {
+    // number of beats sent over the link
+    uint64_t beats;
+    // bytes of a beat
+    size_t beat_bytes;
+    // number of beats after which the frame overhead of the link model is
+    // transmitted
+    size_t frame_beats;
+    // RX FIFO configuration in beats
+    size_t rx_fifo_depth;
+    size_t rx_fifo_prog_full;
+    size_t rx_fifo_prog_empty;
+    // time in nanoseconds from a FIFO threshold crossing until the NFC
+    // message leaves the receiver
+    uint64_t nfc_reaction_ns;
+    // rate in Gbit/s with which the user kernel reads the RX FIFO.
+    // 0 reads every beat as soon as it arrives
+    double consumer_rate_gbps;
+    // time in nanoseconds before the user kernel starts reading
+    uint64_t consumer_delay_ns;
+    // interval in nanoseconds in which the FIFO fill level is sampled
+    uint64_t sample_interval_ns;
+
+    AuroraEmuSimConfig()
+        : beats(1 << 20),
+          beat_bytes(sizeof(ap_uint<512>)),
+          frame_beats(1),
+          rx_fifo_depth(DEFAULT_RX_FIFO_DEPTH),
+          rx_fifo_prog_full(DEFAULT_RX_FIFO_PROG_FULL),
+          rx_fifo_prog_empty(DEFAULT_RX_FIFO_PROG_EMPTY),
+          nfc_reaction_ns(0),
+          consumer_rate_gbps(DEFAULT_LINE_RATE_GBPS),
+          consumer_delay_ns(0),
+          sample_interval_ns(1000) {}
+};
+
+/**
+ * RX FIFO fill level at a point in simulated time
+ */
+struct AuroraEmuSimSample {
+    uint64_t time_ns;
+    size_t fill_level;
+};
+
+/**
+ * Result of a simulation run. All times are simulated times
+ */
+struct AuroraEmuSimResult {
+    // time in nanoseconds until the last beat was read by the consumer
+    double duration_ns;
+    // user data rate in Gbit/s
+    double throughput_gbps;
+    uint32_t xoff_count;
+    uint32_t xon_count;
+    // beats that arrived while the RX FIFO was full. The hardware would
+    // lose them, the simulation keeps them like the emulator
+    uint64_t overflow_beats;
+    size_t max_fill_level;
+    // time in nanoseconds the sender was paused by XOFF
+    double tx_paused_ns;
+    std::vector<AuroraEmuSimSample> occupancy;
+
+    /**
+     * Write the sampled FIFO fill levels as CSV
+     */
+    void write_occupancy_csv(std::ostream &out) const {
+        out << "time_ns,fill_level" << std::endl;
+        for (auto &sample : occupancy) {
+            out << sample.time_ns << "," << sample.fill_level << std::endl;
+        }
+    }
+};
+
+/**
+ * Discrete-event simulation of a single Aurora link with native flow
+ * control.
+ *
+ * The sender transmits beats back-to-back with the line rate and frame
+ * overhead of the link model. Beats arrive at the RX FIFO after the
+ * propagation latency and are read by the user kernel with the consumer
+ * rate. Crossing prog_full sends XOFF and dropping to prog_empty sends
+ * XON, which take the NFC reaction time plus the propagation latency to
+ * reach the sender. The sender stops after the beat it is transmitting.
+ *
+ * Time advances from event to event in picoseconds instead of wall-clock
+ * time, so the results are exact and the same for every run. This is
+ * intended to choose FIFO sizes and thresholds, e.g. for long cables.
+ */
+class AuroraEmuSim {
+   private:
+    enum EventType { SEND, ARRIVE, CONSUME, XOFF_ARRIVE, XON_ARRIVE, SAMPLE };
+
+    struct Event {
+        uint64_t time_ps;
+        // events at the same time are processed in the order of creation
+        uint64_t sequence;
+        EventType type;
+
+        bool operator>(const Event &other) const {
+            return time_ps != other.time_ps ? time_ps > other.time_ps
+                                            : sequence > other.sequence;
+        }
+    };
+
+    AuroraEmuSimConfig config;
+    AuroraEmuLinkModel link_model;
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t sequence;
+
+    void schedule(uint64_t time_ps, EventType type) {
+        events.push(Event{time_ps, sequence++, type});
+    }
+
+    // picoseconds to transmit bytes with the given rate in Gbit/s
+    static uint64_t transmission_ps(size_t bytes, double rate_gbps) {
+        return static_cast<uint64_t>(bytes * 8 * 1000 / rate_gbps + 0.5);
+    }
+
+   public:
+    /**
+     * Create a simulation of a link
+     *
+     * link_model: line rate, latency and frame overhead of the link. The
+     *             link has to be rate limited
+     * config: traffic, FIFO and consumer parameters
+     */
+    AuroraEmuSim(AuroraEmuLinkModel link_model,
+                 AuroraEmuSimConfig config = AuroraEmuSimConfig())
+        : config(config), link_model(link_model), sequence(0) {
+        if (!link_model.is_rate_limited()) {
+            throw std::invalid_argument(
+                "Simulated links need a line rate greater than 0");
+        }
+        if (config.rx_fifo_prog_empty >= config.rx_fifo_prog_full ||
+            config.rx_fifo_prog_full > config.rx_fifo_depth) {
+            throw std::invalid_argument(
+                "RX FIFO thresholds must satisfy prog_empty < prog_full <= "
+                "depth");
+        }
+        if (config.beat_bytes == 0 || config.frame_beats == 0 ||
+            config.sample_interval_ns == 0 || config.consumer_rate_gbps < 0) {
+            throw std::invalid_argument("Invalid simulation configuration");
+        }
+    }
+
+    /**
+     * Run the simulation until the consumer read all beats
+     */
+    AuroraEmuSimResult run() {
+        AuroraEmuSimResult result = AuroraEmuSimResult();
+        uint64_t latency_ps = link_model.get_latency().count() * 1000;
+        uint64_t nfc_delay_ps = config.nfc_reaction_ns * 1000 + latency_ps;
+        uint64_t beat_ps = transmission_ps(config.beat_bytes,
+                                           link_model.get_line_rate_gbps());
+        uint64_t overhead_ps =
+            transmission_ps(link_model.get_frame_overhead_bytes(),
+                            link_model.get_line_rate_gbps());
+        uint64_t consume_ps =
+            config.consumer_rate_gbps > 0
+                ? transmission_ps(config.beat_bytes, config.consumer_rate_gbps)
+                : 0;
+
+        // sender state
+        uint64_t sent = 0;
+        bool paused = false;
+        bool sending = true;
+        uint64_t paused_since = 0;
+        uint64_t tx_paused_ps = 0;
+        // receiver state
+        size_t fill_level = 0;
+        bool xoff_sent = false;
+        bool consuming = false;
+        uint64_t consumer_ready = config.consumer_delay_ns * 1000;
+        uint64_t consumed = 0;
+        uint64_t now = 0;
+
+        sequence = 0;
+        events = decltype(events)();
+        schedule(0, SEND);
+        schedule(0, SAMPLE);
+        while (consumed < config.beats && !events.empty()) {
+            Event event = events.top();
+            events.pop();
+            now = event.time_ps;
+            switch (event.type) {
+                case SEND:
+                    if (paused || sent == config.beats) {
+                        sending = false;
+                        break;
+                    }
+                    sent++;
+                    {
+                        uint64_t duration = beat_ps;
+                        if (sent % config.frame_beats == 0 ||
+                            sent == config.beats) {
+                            duration += overhead_ps;
+                        }
+                        schedule(now + duration + latency_ps, ARRIVE);
+                        schedule(now + duration, SEND);
+                    }
+                    break;
+                case ARRIVE:
+                    if (fill_level >= config.rx_fifo_depth) {
+                        result.overflow_beats++;
+                    }
+                    fill_level++;
+                    result.max_fill_level =
+                        std::max(result.max_fill_level, fill_level);
+                    if (!xoff_sent && fill_level >= config.rx_fifo_prog_full) {
+                        xoff_sent = true;
+                        result.xoff_count++;
+                        schedule(now + nfc_delay_ps, XOFF_ARRIVE);
+                    }
+                    if (!consuming) {
+                        consuming = true;
+                        schedule(std::max(now, consumer_ready), CONSUME);
+                    }
+                    break;
+                case CONSUME:
+                    fill_level--;
+                    consumed++;
+                    consumer_ready = now + consume_ps;
+                    if (xoff_sent && fill_level <= config.rx_fifo_prog_empty) {
+                        xoff_sent = false;
+                        result.xon_count++;
+                        schedule(now + nfc_delay_ps, XON_ARRIVE);
+                    }
+                    if (fill_level > 0) {
+                        schedule(consumer_ready, CONSUME);
+                    } else {
+                        consuming = false;
+                    }
+                    break;
+                case XOFF_ARRIVE:
+                    if (!paused) {
+                        paused = true;
+                        paused_since = now;
+                    }
+                    break;
+                case XON_ARRIVE:
+                    if (paused) {
+                        paused = false;
+                        tx_paused_ps += now - paused_since;
+                    }
+                    // restart the sender if it stopped during the pause
+                    if (!sending) {
+                        sending = true;
+                        schedule(now, SEND);
+                    }
+                    break;
+                case SAMPLE:
+                    result.occupancy.push_back(
+                        AuroraEmuSimSample{now / 1000, fill_level});
+                    schedule(now + config.sample_interval_ns * 1000, SAMPLE);
+                    break;
+            }
+        }
+        if (paused) {
+            tx_paused_ps += now - paused_since;
+        }
+        result.duration_ns = now / 1000.0;
+        result.throughput_gbps =
+            now > 0 ? 8.0 * config.beat_bytes * consumed * 1000 / now : 0;
+        result.tx_paused_ns = tx_paused_ps / 1000.0;
+        return result;
+    }
+};
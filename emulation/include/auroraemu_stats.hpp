@@ -0,0 +1,265 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Nanoseconds of the steady clock. The clock is the same for all processes
+ * of a host, so timestamps can be compared between emulators in different
+ * processes but not between hosts
+ */
+inline uint64_t timestamp_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Write a string as JSON string literal
+ */
+inline void write_json_string(std::ostream &out, const std::string &value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+/**
+ * Live statistics of an emulated link or a shard of the switch.
+ *
+ * Counters are updated by the forwarding threads with relaxed atomics like
+ * AuroraEmuRegisters and can be read from any other thread without locking.
+ * The transit latency of received beats is collected in a histogram with
+ * logarithmic buckets: bucket i counts beats with a latency of less than
+ * 2^(i+1) ns and at least 2^i ns, bucket 0 also counts a latency of 0 ns.
+ */
+class AuroraEmuStats {
+   public:
+    // the last bucket holds latencies of more than 9 minutes
+    enum : uint32_t { NUM_LATENCY_BUCKETS = 40 };
+
+   private:
+    std::atomic<uint64_t> tx_beats;
+    std::atomic<uint64_t> tx_bytes;
+    std::atomic<uint64_t> tx_batches;
+    std::atomic<uint64_t> rx_beats;
+    std::atomic<uint64_t> rx_bytes;
+    std::atomic<uint64_t> rx_batches;
+    std::atomic<int64_t> queue_depth;
+    std::atomic<int64_t> max_queue_depth;
+    std::atomic<uint64_t> latency[NUM_LATENCY_BUCKETS];
+    // start of the measurement, used to calculate the throughput
+    std::atomic<uint64_t> start_ns;
+
+    void update_max_queue_depth(int64_t depth) {
+        int64_t current = max_queue_depth.load(std::memory_order_relaxed);
+        while (current < depth &&
+               !max_queue_depth.compare_exchange_weak(
+                   current, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    double rate_gbps(uint64_t bytes) {
+        uint64_t elapsed = timestamp_ns() - get_start_ns();
+        return elapsed > 0 ? 8.0 * bytes / elapsed : 0;
+    }
+
+   public:
+    AuroraEmuStats() : queue_depth(0) { reset(); }
+
+    AuroraEmuStats(const AuroraEmuStats &) = delete;
+    AuroraEmuStats &operator=(const AuroraEmuStats &) = delete;
+
+    /**
+     * Clear all counters and restart the throughput measurement. The
+     * current queue depth is kept
+     */
+    void reset() {
+        tx_beats.store(0, std::memory_order_relaxed);
+        tx_bytes.store(0, std::memory_order_relaxed);
+        tx_batches.store(0, std::memory_order_relaxed);
+        rx_beats.store(0, std::memory_order_relaxed);
+        rx_bytes.store(0, std::memory_order_relaxed);
+        rx_batches.store(0, std::memory_order_relaxed);
+        max_queue_depth.store(queue_depth.load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
+        for (uint32_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            latency[i].store(0, std::memory_order_relaxed);
+        }
+        start_ns.store(timestamp_ns(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Histogram bucket of a latency in nanoseconds
+     */
+    static uint32_t latency_bucket(uint64_t ns) {
+        uint32_t bucket = 0;
+        while (ns > 1 && bucket + 1 < NUM_LATENCY_BUCKETS) {
+            ns >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    /**
+     * Exclusive upper bound of a histogram bucket in nanoseconds
+     */
+    static uint64_t latency_bucket_limit(uint32_t bucket) {
+        return 2ull << bucket;
+    }
+
+    void add_tx(uint64_t beats, uint64_t bytes) {
+        tx_beats.fetch_add(beats, std::memory_order_relaxed);
+        tx_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        tx_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void add_rx(uint64_t beats, uint64_t bytes) {
+        rx_beats.fetch_add(beats, std::memory_order_relaxed);
+        rx_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        rx_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Count the latency of beats that were sent at the same time
+     */
+    void add_latency(uint64_t ns, uint64_t beats = 1) {
+        latency[latency_bucket(ns)].fetch_add(beats,
+                                              std::memory_order_relaxed);
+    }
+
+    /**
+     * Set the number of beats or messages that are currently queued
+     */
+    void set_queue_depth(int64_t depth) {
+        queue_depth.store(depth, std::memory_order_relaxed);
+        update_max_queue_depth(depth);
+    }
+
+    /**
+     * Change the number of queued beats or messages by delta
+     */
+    void add_queue_depth(int64_t delta) {
+        int64_t depth =
+            queue_depth.fetch_add(delta, std::memory_order_relaxed) + delta;
+        update_max_queue_depth(depth);
+    }
+
+    uint64_t get_tx_beats() { return tx_beats.load(std::memory_order_relaxed); }
+    uint64_t get_tx_bytes() { return tx_bytes.load(std::memory_order_relaxed); }
+    uint64_t get_tx_batches() {
+        return tx_batches.load(std::memory_order_relaxed);
+    }
+    uint64_t get_rx_beats() { return rx_beats.load(std::memory_order_relaxed); }
+    uint64_t get_rx_bytes() { return rx_bytes.load(std::memory_order_relaxed); }
+    uint64_t get_rx_batches() {
+        return rx_batches.load(std::memory_order_relaxed);
+    }
+    int64_t get_queue_depth() {
+        return queue_depth.load(std::memory_order_relaxed);
+    }
+    int64_t get_max_queue_depth() {
+        return max_queue_depth.load(std::memory_order_relaxed);
+    }
+    uint64_t get_start_ns() { return start_ns.load(std::memory_order_relaxed); }
+
+    /**
+     * Sent user data in Gbit/s since the construction or the last reset
+     */
+    double get_tx_gbps() { return rate_gbps(get_tx_bytes()); }
+
+    /**
+     * Received user data in Gbit/s since the construction or the last reset
+     */
+    double get_rx_gbps() { return rate_gbps(get_rx_bytes()); }
+
+    /**
+     * Number of beats in every latency bucket
+     */
+    std::vector<uint64_t> get_latency_histogram() {
+        std::vector<uint64_t> histogram(NUM_LATENCY_BUCKETS);
+        for (uint32_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            histogram[i] = latency[i].load(std::memory_order_relaxed);
+        }
+        return histogram;
+    }
+
+    /**
+     * Upper bound of the latency in nanoseconds of the given fraction of
+     * beats, e.g. 0.99 for the 99th percentile. Returns 0 if no latency was
+     * measured
+     */
+    uint64_t get_latency_percentile_ns(double fraction) {
+        std::vector<uint64_t> histogram = get_latency_histogram();
+        uint64_t total = 0;
+        for (auto count : histogram) {
+            total += count;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            seen += histogram[i];
+            if (seen > 0 && seen >= fraction * total) {
+                return latency_bucket_limit(i);
+            }
+        }
+        return latency_bucket_limit(NUM_LATENCY_BUCKETS - 1);
+    }
+
+    /**
+     * Write the statistics as JSON object. The histogram only contains
+     * the buckets that counted beats, each with its upper bound in ns
+     */
+    void write_json(std::ostream &out) {
+        out << "{\"tx_beats\": " << get_tx_beats()
+            << ", \"tx_bytes\": " << get_tx_bytes()
+            << ", \"tx_batches\": " << get_tx_batches()
+            << ", \"tx_gbps\": " << get_tx_gbps()
+            << ", \"rx_beats\": " << get_rx_beats()
+            << ", \"rx_bytes\": " << get_rx_bytes()
+            << ", \"rx_batches\": " << get_rx_batches()
+            << ", \"rx_gbps\": " << get_rx_gbps()
+            << ", \"queue_depth\": " << get_queue_depth()
+            << ", \"max_queue_depth\": " << get_max_queue_depth()
+            << ", \"latency_p50_ns\": " << get_latency_percentile_ns(0.5)
+            << ", \"latency_p99_ns\": " << get_latency_percentile_ns(0.99)
+            << ", \"latency_histogram\": [";
+        std::vector<uint64_t> histogram = get_latency_histogram();
+        bool first = true;
+        for (uint32_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            if (histogram[i] == 0) {
+                continue;
+            }
+            out << (first ? "" : ", ") << "{\"lt_ns\": "
+                << latency_bucket_limit(i) << ", \"beats\": " << histogram[i]
+                << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+};
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2024 Marius Meyer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// size of the write buffer of a trace file
+const size_t DEFAULT_TRACE_BUFFER_BYTES = 1 << 20;
+
+/**
+ * Header at the start of every trace file
+ */
+struct AuroraEmuTraceHeader {
+    char magic[8];
+    uint32_t version;
+    // bytes of the data of a beat
+    uint32_t beat_bytes;
+    // beats are followed by their keep and last signals
+    uint32_t framing;
+    uint32_t reserved;
+};
+
+/**
+ * Header of every received batch in a trace file. It is followed by the
+ * ID of the source, the ID of the destination and the beats of the batch
+ * in the wire format of pack_batch() without the timestamp
+ */
+struct AuroraEmuTraceRecord {
+    // timestamp_ns() at which the batch was received
+    uint64_t time_ns;
+    uint32_t payload_bytes;
+    uint16_t source_bytes;
+    uint16_t destination_bytes;
+};
+
+/**
+ * Received batch that was read from a trace file
+ */
+struct AuroraEmuTraceEntry {
+    uint64_t time_ns;
+    std::string source;
+    std::string destination;
+    std::vector<char> payload;
+};
+
+static const char AURORA_EMU_TRACE_MAGIC[8] = {'A', 'U', 'R', 'T',
+                                                'R', 'A', 'C', 'E'};
+
+/**
+ * Append-only binary trace of the data received by emulated cores.
+ *
+ * A trace is attached to AuroraEmu or AuroraEmuCore with set_trace(). The
+ * forwarding threads then append every received batch as it arrives from
+ * the link, before the error model and the latency of the link model are
+ * applied. Records are written through a large buffer, so recording costs
+ * a copy of the data. A trace can be shared by several emulators with the
+ * same beat width, records are appended under a lock.
+ */
+class AuroraEmuTraceWriter {
+   private:
+    std::FILE *file;
+    std::unique_ptr<char[]> buffer;
+    std::mutex mutex;
+    uint32_t beat_bytes;
+    bool framing;
+
+   public:
+    /**
+     * Create a trace file. An existing file is overwritten
+     *
+     * path: path of the trace file
+     * beat_bytes: bytes of the data of a beat of the traced emulators
+     * framing: the traced emulators transfer keep and last
+     */
+    AuroraEmuTraceWriter(const std::string &path, uint32_t beat_bytes,
+                         bool framing = false,
+                         size_t buffer_bytes = DEFAULT_TRACE_BUFFER_BYTES)
+        : file(std::fopen(path.c_str(), "wb")),
+          buffer(new char[buffer_bytes]),
+          beat_bytes(beat_bytes),
+          framing(framing) {
+        if (file == nullptr) {
+            throw std::runtime_error("Could not create trace file " + path);
+        }
+        std::setvbuf(file, buffer.get(), _IOFBF, buffer_bytes);
+        AuroraEmuTraceHeader header;
+        std::memcpy(header.magic, AURORA_EMU_TRACE_MAGIC, sizeof(header.magic));
+        header.version = 1;
+        header.beat_bytes = beat_bytes;
+        header.framing = framing;
+        header.reserved = 0;
+        std::fwrite(&header, sizeof(header), 1, file);
+    }
+
+    ~AuroraEmuTraceWriter() { std::fclose(file); }
+
+    AuroraEmuTraceWriter(const AuroraEmuTraceWriter &) = delete;
+    AuroraEmuTraceWriter &operator=(const AuroraEmuTraceWriter &) = delete;
+
+    uint32_t get_beat_bytes() const { return beat_bytes; }
+
+    bool has_framing() const { return framing; }
+
+    /**
+     * Append a received batch
+     */
+    void record(const std::string &source, const std::string &destination,
+                uint64_t time_ns, const void *payload, size_t bytes) {
+        AuroraEmuTraceRecord r;
+        r.time_ns = time_ns;
+        r.payload_bytes = bytes;
+        r.source_bytes = source.size();
+        r.destination_bytes = destination.size();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fwrite(&r, sizeof(r), 1, file);
+        std::fwrite(source.data(), 1, source.size(), file);
+        std::fwrite(destination.data(), 1, destination.size(), file);
+        std::fwrite(payload, 1, bytes, file);
+    }
+
+    /**
+     * Write the buffered records to the file, e.g. before the trace is
+     * read while it is still recorded
+     */
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fflush(file);
+    }
+};
+
+/**
+ * Sequential reader of a trace file that was written by
+ * AuroraEmuTraceWriter
+ */
+class AuroraEmuTraceReader {
+   private:
+    std::FILE *file;
+    AuroraEmuTraceHeader header;
+
+   public:
+    explicit AuroraEmuTraceReader(const std::string &path)
+        : file(std::fopen(path.c_str(), "rb")) {
+        if (file == nullptr) {
+            throw std::runtime_error("Could not open trace file " + path);
+        }
+        if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+            std::memcmp(header.magic, AURORA_EMU_TRACE_MAGIC,
+                        sizeof(header.magic)) != 0 ||
+            header.version != 1) {
+            std::fclose(file);
+            throw std::invalid_argument(path + " is not an Aurora trace");
+        }
+    }
+
+    ~AuroraEmuTraceReader() { std::fclose(file); }
+
+    AuroraEmuTraceReader(const AuroraEmuTraceReader &) = delete;
+    AuroraEmuTraceReader &operator=(const AuroraEmuTraceReader &) = delete;
+
+    uint32_t get_beat_bytes() const { return header.beat_bytes; }
+
+    bool has_framing() const { return header.framing; }
+
+    /**
+     * Read the next batch. Returns false at the end of the trace. An
+     * incomplete last record, e.g. of a trace that is still recorded, is
+     * treated as the end of the trace
+     */
+    bool next(AuroraEmuTraceEntry &entry) {
+        AuroraEmuTraceRecord r;
+        if (std::fread(&r, sizeof(r), 1, file) != 1) {
+            return false;
+        }
+        entry.time_ns = r.time_ns;
+        entry.source.resize(r.source_bytes);
+        entry.destination.resize(r.destination_bytes);
+        entry.payload.resize(r.payload_bytes);
+        return std::fread(&entry.source[0], 1, r.source_bytes, file) ==
+                   r.source_bytes &&
+               std::fread(&entry.destination[0], 1, r.destination_bytes,
+                          file) == r.destination_bytes &&
+               std::fread(entry.payload.data(), 1, r.payload_bytes, file) ==
+                   r.payload_bytes;
+    }
+
+    /**
+     * Start reading at the first batch again
+     */
+    void rewind() {
+        std::fseek(file, sizeof(AuroraEmuTraceHeader), SEEK_SET);
+    }
+};
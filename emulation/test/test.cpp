@@ -15,11 +15,19 @@
  * limitations under the License.
  */
 #include <iostream>
+#include <sstream>
 
 #include "auroraemu.hpp"
+#include "auroraemu_fiber.hpp"
+#include "auroraemu_node.hpp"
+#include "auroraemu_sim.hpp"
 #include "gtest/gtest.h"
 #include "hlslib/xilinx/Stream.h"
 
+// register decoding of the host code without the XRT hardware access
+#define AURORA_NO_XRT
+#include "../../host/Aurora.hpp"
+
 struct AuroraEmuTest : public ::testing::Test {
     AuroraEmuTest() {
         // Empty
@@ -55,16 +63,31 @@ TEST_F(AuroraEmuTest, ConnectLoopback) {
 }
 
 TEST_F(AuroraEmuTest, ConstructorSwitch) {
-    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuSwitch s("127.0.0.1", 20000, 1);
     zmq::context_t ctx(1);
-    zmq::socket_t to_switch(ctx, zmq::socket_type::push);
-    zmq::socket_t from_switch(ctx, zmq::socket_type::sub);
+    zmq::socket_t directory(ctx, zmq::socket_type::req);
+    zmq::socket_t to_switch(ctx, zmq::socket_type::dealer);
+    zmq::socket_t from_switch(ctx, zmq::socket_type::dealer);
 
-    to_switch.connect("tcp://127.0.0.1:20000");
-    from_switch.connect("tcp://127.0.0.1:20001");
+    directory.connect("tcp://127.0.0.1:20000");
+    to_switch.connect("tcp://127.0.0.1:20001");
     std::string id = "test";
-    from_switch.set(zmq::sockopt::subscribe, id);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    from_switch.set(zmq::sockopt::routing_id, id);
+    from_switch.connect("tcp://127.0.0.1:20001");
+
+    // announce the receiver and wait for the acknowledgement
+    zmq::message_t hello(0);
+    from_switch.send(hello, zmq::send_flags::none);
+    auto result = from_switch.recv(hello, zmq::recv_flags::none);
+    EXPECT_EQ(result.has_value(), true);
+    EXPECT_EQ(result.value(), 0);
+    EXPECT_EQ(hello.more(), false);
+
+    zmq::message_t request(std::string("shards"));
+    directory.send(request, zmq::send_flags::none);
+    result = directory.recv(request, zmq::recv_flags::none);
+    EXPECT_EQ(result.has_value(), true);
+    EXPECT_EQ(request.to_string(), "1");
 
     std::string content = "hello";
     zmq::message_t msg(content);
@@ -72,14 +95,12 @@ TEST_F(AuroraEmuTest, ConstructorSwitch) {
     to_switch.send(a_id, zmq::send_flags::sndmore);
     to_switch.send(msg, zmq::send_flags::none);
 
-    auto result = from_switch.recv(msg, zmq::recv_flags::none);
-    EXPECT_EQ(result.has_value(), true);
-    EXPECT_EQ(result.value(), 4);
-    EXPECT_EQ(msg.to_string(), id);
+    // the switch consumes the id to address the receiver
     result = from_switch.recv(msg, zmq::recv_flags::none);
     EXPECT_EQ(result.has_value(), true);
     EXPECT_EQ(result.value(), 5);
     EXPECT_EQ(msg.to_string(), content);
+    EXPECT_EQ(msg.more(), false);
 }
 
 TEST_F(AuroraEmuTest, ConnectSwitchLoopback) {
@@ -234,6 +255,1133 @@ TEST_F(AuroraEmuTest, SwitchDefaultConstructorSend) {
     }
 }
 
+TEST_F(AuroraEmuTest, ConnectTwoBatched) {
+    // set depth of streams to hold all data
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmu a1("batch1", in1, out1, 16, 1000);
+    AuroraEmu a2("batch2", in2, out2, 16, 1000);
+    a1.connect(a2);
+    // the last batch is incomplete and has to be flushed after the timeout
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    EXPECT_TRUE(out2.empty());
+}
+
+TEST_F(AuroraEmuTest, SwitchConnectTwoBatched) {
+    // set depth of streams to hold all data
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, 7, 100);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, 1, 0);
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        in2.write(out2.read());
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out1.read().data, ap_uint<512>(i));
+    }
+}
+
+TEST_F(AuroraEmuTest, SwitchPingPongLatency) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+    // idle cores are woken up on new data, so round trips must not be
+    // limited by a polling interval
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 500; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+        in2.write(out2.read());
+        EXPECT_EQ(out1.read().data, ap_uint<512>(i));
+    }
+    auto duration = std::chrono::steady_clock::now() - start;
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::seconds>(duration)
+                  .count(),
+              5);
+}
+
+TEST_F(AuroraEmuTest, ConstructorSharedMemory) {
+    hlslib::Stream<data_stream_t> in, out;
+    AuroraEmu e("shm", "hans", in, out);
+    EXPECT_EQ(e.get_address(), "shm://hans");
+}
+
+TEST_F(AuroraEmuTest, ConstructorUnsupportedProtocolThrows) {
+    hlslib::Stream<data_stream_t> in, out;
+    EXPECT_THROW(AuroraEmu("udp", "hans", in, out), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, ConnectSharedMemoryLoopback) {
+    hlslib::Stream<data_stream_t> in, out;
+    AuroraEmu e("shm", "hans", in, out);
+    e.connect(e);
+
+    data_stream_t data;
+    data.data = ap_uint<512>(7);
+    in.write(data);
+    data_stream_t data2 = out.read();
+    EXPECT_EQ(data.data, data2.data);
+}
+
+TEST_F(AuroraEmuTest, DestructorLeavesUserStreamEmpty) {
+    hlslib::Stream<data_stream_t> in, out;
+    {
+        // the remote never subscribes, so the TX thread waits until the
+        // destructor stops it
+        AuroraEmu e("127.0.0.1", 20000, in, out);
+        e.connect("tcp://127.0.0.1:20001");
+        EXPECT_FALSE(e.wait_until_connected(10));
+    }
+    {
+        AuroraEmu e("shm", "hans", in, out);
+        e.connect(e);
+    }
+    EXPECT_TRUE(in.empty());
+    EXPECT_TRUE(out.empty());
+}
+
+TEST_F(AuroraEmuTest, ConnectSharedMemoryTwo) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    // use a small ring, so the sender has to wait for the receiver
+    AuroraEmu a1("shm", "a1", in1, out1, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, 16);
+    AuroraEmu a2("shm", "a2", in2, out2, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, 16);
+    a1.connect(a2);
+    std::thread t1([&in1]() {
+        for (int i = 0; i < 1000; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+    });
+    for (int i = 0; i < 1000; i++) {
+        in2.write(out2.read());
+        EXPECT_EQ(out1.read().data, ap_uint<512>(i));
+    }
+    t1.join();
+    EXPECT_TRUE(out1.empty());
+    EXPECT_TRUE(out2.empty());
+}
+
+TEST_F(AuroraEmuTest, ConnectProtocolMismatchThrows) {
+    hlslib::Stream<data_stream_t> in1, out1, in2, out2;
+    AuroraEmu a1("shm", "a1", in1, out1);
+    AuroraEmu a2("a2", in2, out2);
+    EXPECT_THROW(a1.connect(a2), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchFlowControl) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, 8, 0, 64, 32,
+                     8);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, 8, 0, 64, 32,
+                     8);
+    std::atomic<bool> done(false);
+    std::thread t1([&in1, &done]() {
+        for (int i = 0; i < 4000; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+        done = true;
+    });
+    // the receiver does not read, so the sender has to be stopped
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_FALSE(done);
+    EXPECT_GE(a2.get_xoff_count(), 1);
+    EXPECT_LT(a2.get_rx_fifo_fill_level(), 4000);
+    for (int i = 0; i < 4000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    t1.join();
+    EXPECT_GE(a2.get_xon_count(), 1);
+    EXPECT_EQ(a2.get_rx_fifo_fill_level(), 0);
+}
+
+TEST_F(AuroraEmuTest, SwitchFlowControlBoundsRxFifo) {
+    // full batches are larger than the FIFO, so every batch overflows it
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2");
+    hlslib::Stream<data_stream_t, 1> out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, 32, 1000, 16,
+                     8, 2);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, 32, 1000, 16,
+                     8, 2);
+    std::thread t1([&in1]() {
+        for (int i = 0; i < 1000; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_LE(a2.get_rx_fifo_fill_level(), 16);
+    EXPECT_GE(a2.get_rx_overflow_count(), 1);
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    t1.join();
+    EXPECT_LE(a2.get_stats().get_max_queue_depth(), 16);
+    EXPECT_EQ(a2.get_rx_fifo_fill_level(), 0);
+}
+
+TEST_F(AuroraEmuTest, SwitchFlowControlStopsReadingTxStream) {
+    // the TX stream holds all beats, so writing does not block while paused
+    hlslib::Stream<data_stream_t, 16> in1("in1");
+    hlslib::Stream<data_stream_t> out1("out1"), in2("in2");
+    hlslib::Stream<data_stream_t, 1> out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1, 1, 0, 16, 8,
+                     2);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2, 1, 0, 16, 8,
+                     2);
+    // the receiver does not read, so the RX FIFO of a2 passes prog_full
+    for (int i = 0; i < 12; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 100 && a2.get_xoff_count() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(a2.get_xoff_count(), 1);
+    // give the XOFF time to reach a1
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // data written while paused stays in the TX stream
+    data_stream_t data;
+    data.data = ap_uint<512>(12);
+    in1.write(data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(in1.empty());
+    for (int i = 0; i < 13; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+}
+
+TEST_F(AuroraEmuTest, SwitchFlowControlInvalidThresholdsThrow) {
+    hlslib::Stream<data_stream_t> in, out;
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    EXPECT_THROW(AuroraEmuCore("127.0.0.1", 20000, "a1", "a1", in, out, 8, 0,
+                               64, 8, 32),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchRegisterFile) {
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+    AuroraEmuRegisters &r1 = a1.get_registers();
+    AuroraEmuRegisters &r2 = a2.get_registers();
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::CORE_STATUS),
+              AuroraEmuRegisters::CORE_STATUS_OK);
+    // FIFO width of 64 bytes and depth of 2^10 beats
+    uint32_t configuration =
+        r1.read_register(AuroraEmuRegisters::CONFIGURATION);
+    EXPECT_EQ((configuration & 0x7fc) >> 2, 64);
+    EXPECT_EQ((configuration & 0x7800) >> 11, 10);
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::FIFO_THRESHOLDS),
+              (512 << 16) | 128);
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::TX_COUNT), 1000);
+    EXPECT_EQ(r2.read_register(AuroraEmuRegisters::RX_COUNT), 1000);
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::RX_COUNT), 0);
+    r1.write_register(AuroraEmuRegisters::COUNTER_RESET, 1);
+    r1.write_register(AuroraEmuRegisters::COUNTER_RESET, 0);
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::TX_COUNT), 0);
+    EXPECT_EQ(r1.read_register(AuroraEmuRegisters::CORE_STATUS),
+              AuroraEmuRegisters::CORE_STATUS_OK);
+}
+
+TEST_F(AuroraEmuTest, HostReadsEmulatedRegisterFile) {
+    AuroraEmuRegisters registers(64, 1024, 512, 128, true);
+    registers.add(AuroraEmuRegisters::TX_COUNT, 1000);
+    registers.add(AuroraEmuRegisters::RX_COUNT, 500);
+    registers.add(AuroraEmuRegisters::FIFO_RX_OVERFLOW_COUNT, 4);
+    registers.add(AuroraEmuRegisters::NFC_FULL_TRIGGER_COUNT, 3);
+    registers.add(AuroraEmuRegisters::NFC_EMPTY_TRIGGER_COUNT, 2);
+    registers.max(AuroraEmuRegisters::NFC_LATENCY_COUNT, 17);
+    registers.set(AuroraEmuRegisters::FIFO_STATUS,
+                  AuroraEmuRegisters::FIFO_RX_PROG_FULL);
+    Aurora aurora(registers);
+    EXPECT_TRUE(aurora.has_registers());
+    EXPECT_TRUE(aurora.has_framing());
+    EXPECT_EQ(aurora.fifo_width, 64);
+    EXPECT_EQ(aurora.fifo_depth, 1024);
+    EXPECT_EQ(aurora.fifo_prog_full_threshold, 512);
+    EXPECT_EQ(aurora.fifo_prog_empty_threshold, 128);
+    EXPECT_TRUE(aurora.channel_up());
+    EXPECT_TRUE(aurora.fifo_rx_is_prog_full());
+    EXPECT_FALSE(aurora.fifo_rx_is_prog_empty());
+    EXPECT_EQ(aurora.get_tx_count(), 1000);
+    EXPECT_EQ(aurora.get_rx_count(), 500);
+    EXPECT_EQ(aurora.get_fifo_rx_overflow_count(), 4);
+    EXPECT_EQ(aurora.get_nfc_full_trigger_count(), 3);
+    EXPECT_EQ(aurora.get_nfc_empty_trigger_count(), 2);
+    EXPECT_EQ(aurora.get_nfc_latency_count(), 17);
+    aurora.reset_counter();
+    EXPECT_EQ(aurora.get_tx_count(), 0);
+    EXPECT_EQ(aurora.get_nfc_empty_trigger_count(), 0);
+}
+
+TEST_F(AuroraEmuTest, LinkModelRateLimit) {
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    // 64000 bytes at 0.05 Gbit/s take 10.24 ms
+    AuroraEmu a1("ipc", "a1", in1, out1, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH,
+                 AuroraEmuLinkModel(0.05));
+    AuroraEmu a2("ipc", "a2", in2, out2);
+    a1.connect(a2);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(9));
+}
+
+TEST_F(AuroraEmuTest, SwitchLinkModelLatency) {
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuLinkModel link(DEFAULT_LINE_RATE_GBPS, 20000000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY, link);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY, link);
+    // a round trip passes the link twice
+    data_stream_t data;
+    data.data = ap_uint<512>(42);
+    auto start = std::chrono::steady_clock::now();
+    in1.write(data);
+    in2.write(out2.read());
+    EXPECT_EQ(out1.read().data, ap_uint<512>(42));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(40));
+}
+
+TEST_F(AuroraEmuTest, LinkModelNegativeRateThrows) {
+    EXPECT_THROW(AuroraEmuLinkModel(-1.0), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, ConnectTwoFraming) {
+    hlslib::Stream<data_stream_t, 100> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmu a1("ipc", "a1", in1, out1, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH,
+                 AuroraEmuLinkModel::unlimited(), true);
+    AuroraEmu a2("ipc", "a2", in2, out2, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH,
+                 AuroraEmuLinkModel::unlimited(), true);
+    a1.connect(a2);
+    for (int i = 0; i < 100; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.keep = i;
+        data.last = (i % 10) == 9;
+        in1.write(data);
+    }
+    for (int i = 0; i < 100; i++) {
+        data_stream_t data = out2.read();
+        EXPECT_EQ(data.data, ap_uint<512>(i));
+        EXPECT_EQ(data.keep.to_uint64(), i);
+        EXPECT_EQ(data.last.to_uint(), (i % 10) == 9);
+    }
+}
+
+TEST_F(AuroraEmuTest, ConstructorSharedMemoryFramingThrows) {
+    hlslib::Stream<data_stream_t> in, out;
+    EXPECT_THROW(AuroraEmu("shm", "a1", in, out, DEFAULT_BATCH_SIZE,
+                           DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH,
+                           AuroraEmuLinkModel::unlimited(), true),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchFramingFrameErrors) {
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuLinkModel noisy = AuroraEmuLinkModel::unlimited();
+    noisy.set_frame_error_rate(0.5);
+    noisy.set_seed(42);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY,
+                     AuroraEmuLinkModel::unlimited(), true);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY, noisy, true);
+    // 100 frames of 4 beats
+    for (int i = 0; i < 400; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        data.keep = -1;
+        data.last = (i % 4) == 3;
+        in1.write(data);
+    }
+    uint32_t corrupted_frames = 0;
+    bool corrupted = false;
+    for (int i = 0; i < 400; i++) {
+        data_stream_t data = out2.read();
+        corrupted |= (data.data != ap_uint<512>(i));
+        EXPECT_EQ(data.last.to_uint(), (i % 4) == 3);
+        if (data.last) {
+            corrupted_frames += corrupted;
+            corrupted = false;
+        }
+    }
+    AuroraEmuRegisters &r2 = a2.get_registers();
+    EXPECT_EQ(r2.read_register(AuroraEmuRegisters::FRAMES_RECEIVED), 100);
+    EXPECT_EQ(r2.read_register(AuroraEmuRegisters::FRAMES_WITH_ERRORS),
+              corrupted_frames);
+    EXPECT_GT(corrupted_frames, 20);
+    EXPECT_LT(corrupted_frames, 80);
+    // the error model only applies to received data
+    EXPECT_EQ(a1.get_registers().read_register(
+                  AuroraEmuRegisters::FRAMES_RECEIVED),
+              0);
+}
+
+TEST_F(AuroraEmuTest, LinkModelBitErrors) {
+    AuroraEmuLinkModel link = AuroraEmuLinkModel::unlimited();
+    link.set_bit_error_rate(0.001);
+    link.set_seed(1);
+    // a beat has at least one error with a probability of
+    // 1 - 0.999^512 = 0.4
+    int corrupted = 0;
+    for (int i = 0; i < 1000; i++) {
+        ap_uint<512> beat(0);
+        bool flipped = link.inject_errors(beat, false);
+        EXPECT_EQ(flipped, beat != ap_uint<512>(0));
+        corrupted += flipped;
+    }
+    EXPECT_GT(corrupted, 300);
+    EXPECT_LT(corrupted, 500);
+    EXPECT_THROW(link.set_bit_error_rate(1.0), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchZeroShardsThrows) {
+    EXPECT_THROW(AuroraEmuSwitch s("127.0.0.1", 20000, 0),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SwitchIdsArePrefixFree) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2"), in3("in3"), out3("out3");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a10", in1, out1);
+    AuroraEmuCore a10("127.0.0.1", 20000, "a10", "a1", in2, out2);
+    AuroraEmuCore a100("127.0.0.1", 20000, "a100", "a1", in3, out3);
+    data_stream_t data;
+    data.data = ap_uint<512>(10);
+    in1.write(data);
+    EXPECT_EQ(out2.read().data, ap_uint<512>(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(out1.empty(), true);
+    EXPECT_EQ(out3.empty(), true);
+}
+
+TEST_F(AuroraEmuTest, SwitchShardedRing) {
+    const int cores = 16;
+    const int beats = 1000;
+    std::vector<std::unique_ptr<hlslib::Stream<data_stream_t>>> in, out;
+    std::vector<std::unique_ptr<AuroraEmuCore>> ring;
+    AuroraEmuSwitch s("127.0.0.1", 20000, 4);
+    for (int i = 0; i < cores; i++) {
+        in.emplace_back(new hlslib::Stream<data_stream_t>());
+        out.emplace_back(new hlslib::Stream<data_stream_t>());
+    }
+    for (int i = 0; i < cores; i++) {
+        ring.emplace_back(new AuroraEmuCore(
+            "127.0.0.1", 20000, "core" + std::to_string(i),
+            "core" + std::to_string((i + 1) % cores), *in[i], *out[i]));
+    }
+    std::vector<std::thread> receivers;
+    for (int i = 0; i < cores; i++) {
+        receivers.emplace_back([&, i] {
+            int source = (i + cores - 1) % cores;
+            for (int j = 0; j < beats; j++) {
+                EXPECT_EQ(out[i]->read().data,
+                          ap_uint<512>(source * beats + j));
+            }
+        });
+    }
+    for (int i = 0; i < cores; i++) {
+        for (int j = 0; j < beats; j++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i * beats + j);
+            in[i]->write(data);
+        }
+    }
+    for (auto &receiver : receivers) {
+        receiver.join();
+    }
+}
+
+TEST_F(AuroraEmuTest, SwitchHoldsDataUntilConnected) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+    EXPECT_EQ(a1.wait_until_connected(0), true);
+    // send before the receiver exists
+    data_stream_t data;
+    data.data = ap_uint<512>(42);
+    in1.write(data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+    EXPECT_EQ(out2.read().data, ap_uint<512>(42));
+}
+
+TEST_F(AuroraEmuTest, ConnectTwoWaitsForSubscriber) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmu a1("127.0.0.1", 20000, in1, out1);
+    AuroraEmu a2("127.0.0.1", 20001, in2, out2);
+    a1.connect(a2.get_address());
+    EXPECT_EQ(a1.wait_until_connected(0), false);
+    a2.connect(a1.get_address());
+    EXPECT_EQ(a1.wait_until_connected(), true);
+    EXPECT_EQ(a2.wait_until_connected(), true);
+    // first beat is not lost
+    data_stream_t data;
+    data.data = ap_uint<512>(3);
+    in1.write(data);
+    EXPECT_EQ(out2.read().data, ap_uint<512>(3));
+}
+
+TEST_F(AuroraEmuTest, RuntimeSharedRing) {
+    const int cores = 64;
+    const int beats = 100;
+    std::vector<std::unique_ptr<hlslib::Stream<data_stream_t>>> in, out;
+    AuroraEmuSwitch s("127.0.0.1", 20000, 4);
+    // the runtime has to outlive the cores
+    AuroraEmuRuntime runtime(2);
+    std::vector<std::unique_ptr<AuroraEmuCore>> ring;
+    EXPECT_EQ(runtime.get_num_workers(), 2);
+    for (int i = 0; i < cores; i++) {
+        in.emplace_back(new hlslib::Stream<data_stream_t>());
+        out.emplace_back(new hlslib::Stream<data_stream_t>());
+    }
+    for (int i = 0; i < cores; i++) {
+        ring.emplace_back(new AuroraEmuCore(
+            runtime, "127.0.0.1", 20000, "core" + std::to_string(i),
+            "core" + std::to_string((i + 1) % cores), *in[i], *out[i]));
+    }
+    std::vector<std::thread> receivers;
+    for (int i = 0; i < cores; i++) {
+        receivers.emplace_back([&, i] {
+            int source = (i + cores - 1) % cores;
+            for (int j = 0; j < beats; j++) {
+                EXPECT_EQ(out[i]->read().data,
+                          ap_uint<512>(source * beats + j));
+            }
+        });
+    }
+    for (int i = 0; i < cores; i++) {
+        for (int j = 0; j < beats; j++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i * beats + j);
+            in[i]->write(data);
+        }
+    }
+    for (auto &receiver : receivers) {
+        receiver.join();
+    }
+}
+
+TEST_F(AuroraEmuTest, RuntimeFlowControlWithLatency) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuRuntime runtime(1);
+    AuroraEmuLinkModel link(0, 1000000);
+    AuroraEmuCore a1(runtime, "127.0.0.1", 20000, "a1", "a2", in1, out1, 8, 0,
+                     64, 32, 8, link);
+    AuroraEmuCore a2(runtime, "127.0.0.1", 20000, "a2", "a1", in2, out2, 8, 0,
+                     64, 32, 8, link);
+    std::atomic<bool> done(false);
+    std::thread t1([&in1, &done]() {
+        for (int i = 0; i < 4000; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+        }
+        done = true;
+    });
+    // the receiver does not read, so the sender has to be stopped
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_FALSE(done);
+    EXPECT_GE(a2.get_xoff_count(), 1);
+    for (int i = 0; i < 4000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+    }
+    t1.join();
+    EXPECT_GE(a2.get_xon_count(), 1);
+    EXPECT_LE(a2.get_stats().get_max_queue_depth(), 64);
+    EXPECT_EQ(a2.get_rx_fifo_fill_level(), 0);
+}
+
+TEST_F(AuroraEmuTest, RuntimeAbsentPeerDoesNotStallWorker) {
+    hlslib::Stream<data_stream_t, 4000> in1("in1");
+    hlslib::Stream<data_stream_t> out1("out1"), in2("in2"), out2("out2"),
+        in3("in3"), out3("out3");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    {
+        // registers its direct endpoint and disappears
+        hlslib::Stream<data_stream_t> in, out;
+        AuroraEmuCore absent("127.0.0.1", 20000, "b", "a1", in, out);
+    }
+    AuroraEmuRuntime runtime(1);
+    AuroraEmuCore a1(runtime, "127.0.0.1", 20000, "a1", "b", in1, out1, 1);
+    AuroraEmuCore a2(runtime, "127.0.0.1", 20000, "a2", "a3", in2, out2);
+    AuroraEmuCore a3(runtime, "127.0.0.1", 20000, "a3", "a2", in3, out3);
+    // more batches than the socket to the absent core holds
+    for (int i = 0; i < 4000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(in1.empty());
+    for (int i = 0; i < 100; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in2.write(data);
+    }
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    int received = 0;
+    while (received < 100 && std::chrono::steady_clock::now() < deadline) {
+        if (out3.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        EXPECT_EQ(out3.read().data, ap_uint<512>(received));
+        received++;
+    }
+    EXPECT_EQ(received, 100);
+}
+
+TEST_F(AuroraEmuTest, SwitchDirectPair) {
+    hlslib::Stream<data_stream_t, 1000> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+    for (int i = 0; i < 1000; i++) {
+        data_stream_t data;
+        data.data = ap_uint<512>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        in2.write(out2.read());
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out1.read().data, ap_uint<512>(i));
+    }
+    EXPECT_TRUE(a1.is_direct());
+    EXPECT_TRUE(a2.is_direct());
+}
+
+TEST_F(AuroraEmuTest, SwitchDirectFallsBackToSwitch) {
+    hlslib::Stream<data_stream_t> in1("in1"), out1("out1"), in2("in2"),
+        out2("out2"), in3("in3"), out3("out3");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+    // a2 does not exist yet, so a1 sends via the switch
+    data_stream_t data;
+    data.data = ap_uint<512>(42);
+    in1.write(data);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a3", in2, out2);
+    EXPECT_EQ(out2.read().data, ap_uint<512>(42));
+    EXPECT_FALSE(a1.is_direct());
+    // a3 does not register for direct data
+    AuroraEmuCore a3("127.0.0.1", 20000, "a3", "a1", in3, out3,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY,
+                     AuroraEmuLinkModel::unlimited(), false, false);
+    in2.write(data);
+    EXPECT_EQ(out3.read().data, ap_uint<512>(42));
+    EXPECT_FALSE(a2.is_direct());
+    in3.write(data);
+    EXPECT_EQ(out1.read().data, ap_uint<512>(42));
+    EXPECT_FALSE(a3.is_direct());
+}
+
+typedef ap_axiu<256, 0, 0, 0> narrow_stream_t;
+
+TEST_F(AuroraEmuTest, PackBatchNarrowBeats) {
+    std::vector<narrow_stream_t> batch(3);
+    for (int i = 0; i < 3; i++) {
+        batch[i].data = ap_uint<256>(i + 1);
+        batch[i].keep = ap_uint<32>(0xffffffffu);
+        batch[i].last = (i == 2);
+    }
+    zmq::message_t msg;
+    EXPECT_EQ(pack_batch(batch, false, msg), 1);
+    EXPECT_EQ(msg.size(), 3 * 32 + sizeof(uint64_t));
+    uint64_t before = timestamp_ns();
+    EXPECT_EQ(pack_batch(batch, true, msg), 1);
+    EXPECT_EQ(msg.size(),
+              3 * (32 + sizeof(AuroraEmuSideband)) + sizeof(uint64_t));
+    EXPECT_GE(batch_timestamp(msg.data(), msg.size()), before);
+    EXPECT_LE(batch_timestamp(msg.data(), msg.size()), timestamp_ns());
+    std::vector<narrow_stream_t> unpacked;
+    EXPECT_EQ(unpack_batch<narrow_stream_t>(
+                  msg.data(), msg.size(), true,
+                  [&unpacked](narrow_stream_t &beat) {
+                      unpacked.push_back(beat);
+                  }),
+              3);
+    ASSERT_EQ(unpacked.size(), 3);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(unpacked[i].data, batch[i].data);
+        EXPECT_EQ(unpacked[i].keep, batch[i].keep);
+        EXPECT_EQ(unpacked[i].last, batch[i].last);
+    }
+}
+
+TEST_F(AuroraEmuTest, SwitchNarrowStream) {
+    hlslib::Stream<narrow_stream_t, 1000> in1("in1"), out1("out1"),
+        in2("in2"), out2("out2");
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    BasicAuroraEmuCore<narrow_stream_t> a1("127.0.0.1", 20000, "a1", "a2",
+                                           in1, out1);
+    BasicAuroraEmuCore<narrow_stream_t> a2("127.0.0.1", 20000, "a2", "a1",
+                                           in2, out2);
+    // FIFO width of 32 bytes
+    uint32_t configuration =
+        a1.get_registers().read_register(AuroraEmuRegisters::CONFIGURATION);
+    EXPECT_EQ((configuration & 0x7fc) >> 2, 32);
+    for (int i = 0; i < 1000; i++) {
+        narrow_stream_t data;
+        data.data = ap_uint<256>(i);
+        in1.write(data);
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(out2.read().data, ap_uint<256>(i));
+    }
+}
+
+TEST_F(AuroraEmuTest, ConnectSharedMemoryNarrowStream) {
+    hlslib::Stream<narrow_stream_t> in("in"), out("out");
+    BasicAuroraEmu<narrow_stream_t> e("shm", "hans", in, out);
+    e.connect(e);
+    for (int i = 0; i < 100; i++) {
+        narrow_stream_t data;
+        data.data = ap_uint<256>(i);
+        in.write(data);
+        EXPECT_EQ(out.read().data, ap_uint<256>(i));
+    }
+}
+
+TEST_F(AuroraEmuTest, ConnectSharedMemoryWidthMismatchThrows) {
+    hlslib::Stream<data_stream_t> in1, out1;
+    hlslib::Stream<narrow_stream_t> in2, out2;
+    AuroraEmu a1("shm", "a1", in1, out1);
+    BasicAuroraEmu<narrow_stream_t> a2("shm", "a2", in2, out2);
+    EXPECT_THROW(a2.connect(a1.get_address()), std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, SimLineRate) {
+    AuroraEmuSimConfig config;
+    config.beats = 1000;
+    config.consumer_rate_gbps = 0;
+    AuroraEmuSim sim(AuroraEmuLinkModel(100), config);
+    AuroraEmuSimResult result = sim.run();
+    // 1000 beats of 64 bytes take 5.12 ns each
+    EXPECT_DOUBLE_EQ(result.duration_ns, 5120);
+    EXPECT_DOUBLE_EQ(result.throughput_gbps, 100);
+    EXPECT_EQ(result.xoff_count, 0);
+    EXPECT_EQ(result.occupancy.size(), 6);
+}
+
+TEST_F(AuroraEmuTest, SimLongCable) {
+    // 1 us propagation latency with a consumer at half the line rate
+    AuroraEmuLinkModel link(100, 1000);
+    AuroraEmuSimConfig config;
+    config.beats = 100000;
+    config.consumer_rate_gbps = 50;
+    AuroraEmuSimResult result = AuroraEmuSim(link, config).run();
+    EXPECT_GT(result.xoff_count, 0);
+    EXPECT_EQ(result.xon_count, result.xoff_count);
+    EXPECT_EQ(result.overflow_beats, 0);
+    EXPECT_GT(result.tx_paused_ns, 0);
+    // the FIFO runs empty, because beats sent after XON arrive only after
+    // two times the latency
+    EXPECT_LT(result.throughput_gbps, 48);
+    // results do not depend on the host
+    AuroraEmuSimResult again = AuroraEmuSim(link, config).run();
+    EXPECT_EQ(again.duration_ns, result.duration_ns);
+    EXPECT_EQ(again.max_fill_level, result.max_fill_level);
+
+    // a higher prog_empty keeps the consumer busy
+    config.rx_fifo_prog_empty = 256;
+    result = AuroraEmuSim(link, config).run();
+    EXPECT_GT(result.throughput_gbps, 49.9);
+    EXPECT_EQ(result.overflow_beats, 0);
+
+    // prog_full close to the depth overflows with beats in flight
+    config.rx_fifo_prog_full = 960;
+    result = AuroraEmuSim(link, config).run();
+    EXPECT_GT(result.overflow_beats, 0);
+    EXPECT_GT(result.max_fill_level, 1024);
+}
+
+TEST_F(AuroraEmuTest, SimInvalidConfigThrows) {
+    EXPECT_THROW(AuroraEmuSim(AuroraEmuLinkModel::unlimited()),
+                 std::invalid_argument);
+    AuroraEmuSimConfig config;
+    config.rx_fifo_prog_full = 2048;
+    EXPECT_THROW(AuroraEmuSim(AuroraEmuLinkModel(), config),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, FiberPipeline) {
+    const int stages = 100;
+    const int beats = 100;
+    AuroraEmuRuntime runtime(1);
+    std::vector<std::unique_ptr<AuroraEmuStream<data_stream_t>>> streams;
+    for (int i = 0; i <= stages; i++) {
+        streams.emplace_back(new AuroraEmuStream<data_stream_t>());
+    }
+    // all stages are executed by a single worker
+    std::vector<std::unique_ptr<AuroraEmuFiber>> kernels;
+    for (int i = 0; i < stages; i++) {
+        kernels.emplace_back(new AuroraEmuFiber(runtime, [&, i] {
+            for (int j = 0; j < beats; j++) {
+                data_stream_t data = streams[i]->read();
+                data.data += 1;
+                streams[i + 1]->write(data);
+            }
+        }));
+    }
+    std::thread sender([&] {
+        for (int j = 0; j < beats; j++) {
+            data_stream_t data;
+            data.data = j;
+            streams.front()->write(data);
+        }
+    });
+    for (int j = 0; j < beats; j++) {
+        EXPECT_EQ(streams.back()->read().data, ap_uint<512>(j + stages));
+    }
+    sender.join();
+    for (auto &kernel : kernels) {
+        kernel->join();
+        EXPECT_TRUE(kernel->is_finished());
+    }
+    // kernels can not take an AuroraEmuStream as hlslib::Stream by mistake
+    EXPECT_FALSE((std::is_convertible<AuroraEmuStream<data_stream_t> &,
+                                      hlslib::Stream<data_stream_t> &>::value));
+}
+
+TEST_F(AuroraEmuTest, FiberSwitchPingPong) {
+    const int rounds = 16;
+    AuroraEmuStream<data_stream_t> in1, out1, in2, out2;
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    AuroraEmuRuntime runtime(1);
+    AuroraEmuCore a1(runtime, "127.0.0.1", 20000, "a1", "a2",
+                     in1.get_stream(), out1.get_stream());
+    AuroraEmuCore a2(runtime, "127.0.0.1", 20000, "a2", "a1",
+                     in2.get_stream(), out2.get_stream());
+    // kernels and cores share the worker of the runtime
+    AuroraEmuFiber ping(runtime, [&] {
+        for (int i = 0; i < rounds; i++) {
+            data_stream_t data;
+            data.data = i;
+            in1.write(data);
+            EXPECT_EQ(out1.read().data, ap_uint<512>(i + 1));
+        }
+    });
+    AuroraEmuFiber pong(runtime, [&] {
+        for (int i = 0; i < rounds; i++) {
+            data_stream_t data = out2.read();
+            data.data += 1;
+            in2.write(data);
+        }
+    });
+    ping.join();
+    pong.join();
+}
+
+TEST_F(AuroraEmuTest, FiberJoinRethrows) {
+    AuroraEmuRuntime runtime(1);
+    AuroraEmuFiber kernel(runtime, [] {
+        AuroraEmuFiber::yield();
+        throw std::runtime_error("kernel failed");
+    });
+    EXPECT_THROW(kernel.join(), std::runtime_error);
+    EXPECT_EQ(AuroraEmuFiber::current(), nullptr);
+}
+
+TEST_F(AuroraEmuTest, BufferPoolReusesBuffers) {
+    std::unique_ptr<AuroraEmuBufferPool> pool(new AuroraEmuBufferPool(64, 1));
+    {
+        zmq::message_t a, b;
+        char *buffer = pool->message(a, 64);
+        std::memset(buffer, 1, 64);
+        EXPECT_EQ(a.data(), buffer);
+        EXPECT_EQ(a.size(), 64);
+        // the pool grows while all buffers are in flight
+        pool->message(b, 32);
+        EXPECT_EQ(b.size(), 32);
+        EXPECT_EQ(pool->get_num_buffers(), 2);
+    }
+    {
+        zmq::message_t a, b;
+        pool->message(a, 64);
+        pool->message(b, 64);
+        EXPECT_EQ(pool->get_num_buffers(), 2);
+        // messages may outlive the pool and free their buffers later
+        pool.reset();
+        std::memset(b.data(), 2, b.size());
+    }
+}
+
+TEST_F(AuroraEmuTest, FifoWrapsAndGrows) {
+    AuroraEmuFifo<int> fifo(4);
+    int next = 0;
+    for (int i = 0; i < 100; i++) {
+        fifo.push_back(i);
+        if (i % 3 == 0) {
+            // keep the fill level growing, so the ring wraps and grows
+            EXPECT_EQ(fifo.front(), next++);
+            fifo.pop_front();
+        }
+    }
+    EXPECT_EQ(fifo.size(), 100 - next);
+    while (!fifo.empty()) {
+        EXPECT_EQ(fifo.front(), next++);
+        fifo.pop_front();
+    }
+    EXPECT_EQ(next, 100);
+}
+
+TEST_F(AuroraEmuTest, StatsLatencyHistogram) {
+    AuroraEmuStats stats;
+    EXPECT_EQ(AuroraEmuStats::latency_bucket(0), 0);
+    EXPECT_EQ(AuroraEmuStats::latency_bucket(1), 0);
+    EXPECT_EQ(AuroraEmuStats::latency_bucket(2), 1);
+    EXPECT_EQ(AuroraEmuStats::latency_bucket(1000), 9);
+    EXPECT_EQ(AuroraEmuStats::latency_bucket_limit(9), 1024);
+    EXPECT_EQ(stats.get_latency_percentile_ns(0.5), 0);
+    stats.add_latency(1000, 90);
+    stats.add_latency(100000, 10);
+    EXPECT_EQ(stats.get_latency_histogram()[9], 90);
+    EXPECT_EQ(stats.get_latency_percentile_ns(0.5), 1024);
+    EXPECT_EQ(stats.get_latency_percentile_ns(0.99), 131072);
+    stats.add_queue_depth(5);
+    stats.add_queue_depth(-3);
+    EXPECT_EQ(stats.get_queue_depth(), 2);
+    EXPECT_EQ(stats.get_max_queue_depth(), 5);
+    stats.reset();
+    EXPECT_EQ(stats.get_latency_percentile_ns(0.5), 0);
+    EXPECT_EQ(stats.get_queue_depth(), 2);
+    EXPECT_EQ(stats.get_max_queue_depth(), 2);
+}
+
+TEST_F(AuroraEmuTest, SwitchStats) {
+    const int beats = 1000;
+    hlslib::Stream<data_stream_t> in1, out1, in2, out2;
+    AuroraEmuSwitch s("127.0.0.1", 20000, 2);
+    // all data passes the switch
+    AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY,
+                     AuroraEmuLinkModel::unlimited(), false, false);
+    AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2,
+                     DEFAULT_BATCH_SIZE, DEFAULT_FLUSH_TIMEOUT,
+                     DEFAULT_RX_FIFO_DEPTH, DEFAULT_RX_FIFO_PROG_FULL,
+                     DEFAULT_RX_FIFO_PROG_EMPTY,
+                     AuroraEmuLinkModel::unlimited(), false, false);
+    for (int i = 0; i < beats; i++) {
+        in1.write(data_stream_t());
+        out2.read();
+    }
+    EXPECT_EQ(a1.get_stats().get_tx_beats(), beats);
+    EXPECT_EQ(a1.get_stats().get_tx_bytes(), beats * 64);
+    EXPECT_EQ(a2.get_stats().get_rx_beats(), beats);
+    EXPECT_EQ(a2.get_stats().get_rx_batches(),
+              a1.get_stats().get_tx_batches());
+    EXPECT_GT(a2.get_stats().get_rx_gbps(), 0);
+    // every received beat has a latency
+    uint64_t measured = 0;
+    for (auto count : a2.get_stats().get_latency_histogram()) {
+        measured += count;
+    }
+    EXPECT_EQ(measured, beats);
+    EXPECT_GT(a2.get_stats().get_latency_percentile_ns(0.5), 0);
+    uint64_t switch_bytes = 0;
+    for (size_t i = 0; i < s.get_num_shards(); i++) {
+        switch_bytes += s.get_shard_stats(i).get_rx_bytes();
+    }
+    // every batch carries a timestamp
+    EXPECT_EQ(switch_bytes,
+              beats * 64 + a1.get_stats().get_tx_batches() * sizeof(uint64_t));
+    std::stringstream json;
+    a2.write_stats_json(json);
+    EXPECT_EQ(json.str().find("{\"id\": \"a2\", \"remote_id\": \"a1\""), 0);
+    EXPECT_NE(json.str().find("\"rx_beats\": 1000"), std::string::npos);
+    json.str("");
+    s.write_stats_json(json);
+    EXPECT_NE(json.str().find("{\"shard\": 1"), std::string::npos);
+}
+
+TEST_F(AuroraEmuTest, ConnectTwoStatsWithLatency) {
+    hlslib::Stream<data_stream_t> in1, out1, in2, out2;
+    AuroraEmuLinkModel link(0, 100000);
+    AuroraEmu e1("ipc", "stats1", in1, out1, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH, link);
+    AuroraEmu e2("ipc", "stats2", in2, out2, DEFAULT_BATCH_SIZE,
+                 DEFAULT_FLUSH_TIMEOUT, DEFAULT_RING_DEPTH, link);
+    e1.connect(e2);
+    in1.write(data_stream_t());
+    out2.read();
+    EXPECT_EQ(e1.get_stats().get_tx_beats(), 1);
+    EXPECT_EQ(e2.get_stats().get_rx_beats(), 1);
+    EXPECT_EQ(e2.get_stats().get_max_queue_depth(), 1);
+    EXPECT_EQ(e2.get_stats().get_queue_depth(), 0);
+    // the latency includes the 100 us of the link
+    EXPECT_GE(e2.get_stats().get_latency_percentile_ns(0.5), 131072);
+}
+
+TEST_F(AuroraEmuTest, TraceRecordAndReplay) {
+    const int beats = 200;
+    const std::string path = "auroraemu_test.trace";
+    hlslib::Stream<data_stream_t> in1, out1, in2, out2;
+    {
+        AuroraEmuTraceWriter writer(path, 64);
+        AuroraEmuSwitch s("127.0.0.1", 20000);
+        AuroraEmuCore a1("127.0.0.1", 20000, "a1", "a2", in1, out1);
+        AuroraEmuCore a2("127.0.0.1", 20000, "a2", "a1", in2, out2);
+        a2.set_trace(&writer);
+        for (int i = 0; i < beats; i++) {
+            data_stream_t data;
+            data.data = ap_uint<512>(i);
+            in1.write(data);
+            EXPECT_EQ(out2.read().data, ap_uint<512>(i));
+        }
+        a2.set_trace(nullptr);
+    }
+    AuroraEmuTraceReader reader(path);
+    EXPECT_EQ(reader.get_beat_bytes(), 64);
+    AuroraEmuTraceEntry entry;
+    ASSERT_TRUE(reader.next(entry));
+    EXPECT_EQ(entry.source, "a1");
+    EXPECT_EQ(entry.destination, "a2");
+    reader.rewind();
+    // replay the recorded beats into the stream of a consumer
+    hlslib::Stream<data_stream_t> replayed;
+    std::thread consumer([&] {
+        for (int i = 0; i < beats; i++) {
+            EXPECT_EQ(replayed.read().data, ap_uint<512>(i));
+        }
+    });
+    EXPECT_EQ(replay_trace(reader, replayed, 0, "a2"), beats);
+    consumer.join();
+    reader.rewind();
+    EXPECT_EQ(replay_trace(reader, replayed, 0, "a1"), 0);
+    reader.rewind();
+    hlslib::Stream<narrow_stream_t> narrow;
+    EXPECT_THROW(replay_trace(reader, narrow), std::invalid_argument);
+    std::remove(path.c_str());
+}
+
+TEST_F(AuroraEmuTest, ParseFpgaLinks) {
+    auto links = parse_fpga_links(
+        "--fpgalink=n00:acl0:ch1-n01:acl2:ch0 n03:acl1:ch1-n03:acl1:ch1");
+    ASSERT_EQ(links.size(), 2);
+    EXPECT_EQ(links[0].first.to_string(), "n00:acl0:ch1");
+    EXPECT_EQ(links[0].second.node, 1);
+    EXPECT_EQ(links[0].second.device, 2);
+    EXPECT_EQ(links[0].second.channel, 0);
+    EXPECT_EQ(links[1].first, links[1].second);
+    EXPECT_THROW(parse_fpga_links("n00:acl0:ch1"), std::invalid_argument);
+    EXPECT_THROW(parse_fpga_links("n00:acl0:ch1-n00:acl1"),
+                 std::invalid_argument);
+}
+
+TEST_F(AuroraEmuTest, NodeRingFromLinkList) {
+    const int beats = 100;
+    AuroraEmuSwitch s("127.0.0.1", 20000);
+    // links of scripts/configure_ring.sh
+    AuroraEmuNode node("127.0.0.1", 20000,
+                       "--fpgalink=n00:acl0:ch1-n00:acl1:ch0 "
+                       "--fpgalink=n00:acl1:ch1-n00:acl2:ch0 "
+                       "--fpgalink=n00:acl2:ch1-n00:acl0:ch0");
+    EXPECT_EQ(node.get_num_devices(), 3);
+    for (uint32_t d = 0; d < 3; d++) {
+        for (int i = 0; i < beats; i++) {
+            data_stream_t beat;
+            beat.data = d * beats + i;
+            node.tx(d, 1).write(beat);
+        }
+    }
+    for (uint32_t d = 0; d < 3; d++) {
+        uint32_t next = (d + 1) % 3;
+        for (int i = 0; i < beats; i++) {
+            EXPECT_EQ(node.rx(next, 0).read().data,
+                      ap_uint<512>(d * beats + i));
+        }
+    }
+    EXPECT_EQ(node.get_core(1, 0).get_stats().get_rx_beats(), beats);
+    EXPECT_THROW(AuroraEmuNode("127.0.0.1", 20000,
+                               "n00:acl0:ch0-n00:acl1:ch0 "
+                               "n00:acl0:ch0-n00:acl2:ch0"),
+                 std::invalid_argument);
+    EXPECT_THROW(AuroraEmuNode("127.0.0.1", 20000, "n00:acl3:ch0-n01:acl0:ch0"),
+                 std::invalid_argument);
+    // links of other nodes are ignored
+    AuroraEmuNode other("127.0.0.1", 20000, "n01:acl0:ch0-n02:acl0:ch0", 0, 1);
+    EXPECT_FALSE(other.is_connected(0, 0));
+    EXPECT_THROW(other.get_core(0, 0), std::runtime_error);
+    EXPECT_THROW(other.tx(1, 0), std::out_of_range);
+}
+
 int main(int argc, char *argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2023-2025 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stand-in for the aurora_flow kernels in software emulation. Every
+// instance bridges its tx_axis and rx_axis streams through an emulated
+// Aurora core, so the data of the send and recv kernels is routed through
+// an emulated switch like between real QSFP ports. Only for sw_emu, this
+// kernel can not be synthesized.
+
+#include <hls_stream.h>
+#include <ap_int.h>
+#include <ap_axi_sdata.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "auroraemu.hpp"
+
+#ifndef DATA_WIDTH_BYTES
+#define DATA_WIDTH_BYTES 64
+#endif
+
+#define DATA_WIDTH (DATA_WIDTH_BYTES * 8)
+
+typedef ap_axiu<DATA_WIDTH, 0, 0, 0> beat_t;
+
+// The cores are kept between the kernel runs, so beats that are still in
+// flight at the end of a run are delivered in the next one
+struct EmulatedLink {
+    unsigned int remote;
+    hlslib::Stream<beat_t> tx;
+    hlslib::Stream<beat_t> rx;
+    std::unique_ptr<BasicAuroraEmuCore<beat_t>> core;
+};
+
+static std::mutex links_mutex;
+// all instances run in the same emulation process and share the switch
+static std::unique_ptr<AuroraEmuSwitch> links_switch;
+static std::map<unsigned int, std::unique_ptr<EmulatedLink>> links;
+
+static std::string core_id(unsigned int instance)
+{
+    return "aurora_flow_emu_" + std::to_string(instance);
+}
+
+static EmulatedLink &get_link(unsigned int instance, unsigned int remote, unsigned int switch_port)
+{
+    std::lock_guard<std::mutex> lock(links_mutex);
+    if (!links_switch) {
+        links_switch.reset(new AuroraEmuSwitch("127.0.0.1", switch_port));
+    }
+    std::unique_ptr<EmulatedLink> &link = links[instance];
+    if (!link || link->remote != remote) {
+        link.reset(new EmulatedLink());
+        link->remote = remote;
+        link->core.reset(new BasicAuroraEmuCore<beat_t>("127.0.0.1", switch_port, core_id(instance), core_id(remote), link->tx, link->rx));
+    }
+    return *link;
+}
+
+extern "C"
+{
+    void aurora_flow_emu(
+        hls::stream<beat_t> &tx_axis,
+        hls::stream<beat_t> &rx_axis,
+        unsigned int instance,
+        unsigned int remote,
+        unsigned int byte_size,
+        unsigned int iterations,
+        unsigned int switch_port
+    ) {
+        EmulatedLink &link = get_link(instance, remote, switch_port);
+        // every instance sends and receives one message per iteration
+        uint64_t beats = (uint64_t)(byte_size / DATA_WIDTH_BYTES) * iterations;
+        uint64_t tx_beats = 0;
+        uint64_t rx_beats = 0;
+        beat_t pending;
+        bool has_pending = false;
+        // yields first and then sleeps up to about 1 ms while both
+        // directions are idle
+        AuroraEmuBackoff backoff;
+        // the send and recv kernels of an instance run at different times,
+        // so neither direction may block the other
+        while (tx_beats < beats || rx_beats < beats) {
+            bool progress = false;
+            if (tx_beats < beats && !tx_axis.empty() && !link.tx.full()) {
+                link.tx.write(tx_axis.read());
+                tx_beats++;
+                progress = true;
+            }
+            if (!has_pending && rx_beats < beats && !link.rx.empty()) {
+                pending = link.rx.read();
+                has_pending = true;
+            }
+            if (has_pending && rx_axis.write_nb(pending)) {
+                has_pending = false;
+                rx_beats++;
+                progress = true;
+            }
+            if (progress) {
+                backoff.reset();
+            } else {
+                backoff.wait();
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023-2025 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <ap_int.h>
+
+// Statistics of latencies in cycles, which are accumulated on chip and
+// written to memory for the host: count, min, max, sum and a histogram,
+// where bucket b counts the latencies from 2^b to 2^(b+1)-1 cycles. The
+// min is all ones without latencies.
+
+#define LATENCY_COUNT 0
+#define LATENCY_MIN 1
+#define LATENCY_MAX 2
+#define LATENCY_SUM 3
+#define LATENCY_HEADER 4
+#define LATENCY_BUCKETS 32
+#define LATENCY_WORDS (LATENCY_HEADER + LATENCY_BUCKETS)
+
+typedef ap_uint<64> latency_stats_t[LATENCY_WORDS];
+
+static void latency_init(latency_stats_t stats)
+{
+latency_init_words:
+    for (int w = 0; w < LATENCY_WORDS; w++) {
+#pragma HLS UNROLL
+        stats[w] = 0;
+    }
+    stats[LATENCY_MIN] = -1;
+}
+
+static void latency_add(latency_stats_t stats, ap_uint<64> latency)
+{
+    stats[LATENCY_COUNT]++;
+    stats[LATENCY_SUM] += latency;
+    if (latency < stats[LATENCY_MIN]) {
+        stats[LATENCY_MIN] = latency;
+    }
+    if (latency > stats[LATENCY_MAX]) {
+        stats[LATENCY_MAX] = latency;
+    }
+    unsigned int bucket = 0;
+latency_add_bucket:
+    for (int b = 1; b < LATENCY_BUCKETS; b++) {
+#pragma HLS UNROLL
+        if (latency >= ((ap_uint<64>)1 << b)) {
+            bucket = b;
+        }
+    }
+    stats[LATENCY_HEADER + bucket]++;
+}
+
+static void latency_write(latency_stats_t stats, ap_uint<64> *latency_output)
+{
+latency_write_words:
+    for (int w = 0; w < LATENCY_WORDS; w++) {
+#pragma HLS PIPELINE II = 1
+        latency_output[w] = stats[w];
+    }
+}
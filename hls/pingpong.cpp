@@ -0,0 +1,131 @@
+/*
+ * Copyright 2023-2025 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hls_stream.h>
+#include <ap_int.h>
+#include <ap_axi_sdata.h>
+
+#ifndef DATA_WIDTH_BYTES
+#define DATA_WIDTH_BYTES 64
+#endif
+
+#define DATA_WIDTH (DATA_WIDTH_BYTES * 8)
+
+#include "latency.hpp"
+
+// Round trips over an Aurora link. Every port of the link has one instance
+// of the kernel, which either pings or echoes the messages of the other
+// side as pong. With a loopback cable, the ping receives its own messages.
+
+// word of the output of ping after the latency statistics, the number of
+// beats of the replies that differ from the message
+#define PINGPONG_ERRORS LATENCY_WORDS
+
+extern "C"
+{
+    // expected content of a beat, unique in every round trip
+    static ap_uint<DATA_WIDTH> ping_beat(unsigned int n, unsigned int i)
+    {
+        return ((ap_uint<DATA_WIDTH>)n << 32) | (ap_uint<DATA_WIDTH>)i;
+    }
+
+    // Sends a message and waits for all beats of the reply, the round trip
+    // is measured from the first beat out to the last beat in. Sending and
+    // receiving share one loop, because the reply arrives while larger
+    // messages are still sent.
+    void ping(
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input,
+        unsigned int chunks,
+        unsigned int frame_size,
+        unsigned int round_trips,
+        ap_uint<64> *latency_output
+    ) {
+        ap_uint<64> cycles = 0;
+        ap_uint<64> errors = 0;
+        latency_stats_t stats;
+#pragma HLS ARRAY_PARTITION variable = stats complete
+        latency_init(stats);
+    ping_round_trips:
+        for (unsigned int n = 0; n < round_trips; n++) {
+            ap_uint<64> start = cycles;
+            unsigned int sent = 0;
+            unsigned int received = 0;
+        ping_chunks:
+            while (received < chunks) {
+                #pragma HLS PIPELINE II = 1
+                cycles++;
+                if (sent < chunks && !data_output.full()) {
+                    ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
+                    temp.data = ping_beat(n, sent);
+                    if (frame_size != 0) {
+                        temp.last = (((sent + 1) % frame_size) == 0) || ((sent + 1) == chunks);
+                        temp.keep = -1;
+                    }
+                    data_output.write(temp);
+                    if (sent == 0) {
+                        start = cycles;
+                    }
+                    sent++;
+                }
+                if (!data_input.empty()) {
+                    ap_axiu<DATA_WIDTH, 0, 0, 0> temp = data_input.read();
+                    if (temp.data != ping_beat(n, received)) {
+                        errors++;
+                    }
+                    received++;
+                }
+            }
+            latency_add(stats, cycles - start);
+        }
+        latency_write(stats, latency_output);
+        latency_output[PINGPONG_ERRORS] = errors;
+    }
+
+    // echoes every beat back to the ping
+    void pong(
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input,
+        unsigned int chunks,
+        unsigned int round_trips
+    ) {
+    pong_round_trips:
+        for (unsigned int n = 0; n < round_trips; n++) {
+        pong_chunks:
+            for (unsigned int i = 0; i < chunks; i++) {
+                #pragma HLS PIPELINE II = 1
+                data_output.write(data_input.read());
+            }
+        }
+    }
+
+    void pingpong(
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output,
+        hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_input,
+        unsigned int byte_size,
+        unsigned int frame_size,
+        unsigned int round_trips,
+        unsigned int is_ping,
+        ap_uint<64> *latency_output
+    ) {
+        unsigned int chunks = byte_size / DATA_WIDTH_BYTES;
+        if (is_ping) {
+            ping(data_output, data_input, chunks, frame_size, round_trips, latency_output);
+        } else {
+            pong(data_output, data_input, chunks, round_trips);
+        }
+    }
+}
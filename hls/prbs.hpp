@@ -0,0 +1,55 @@
+/*
+ * Copyright 2023-2025 Gerrit Pape (papeg@mail.upb.de)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <ap_int.h>
+
+// Pseudo-random test data that can be generated and checked on chip at
+// II=1. Every 64 bit lane of a beat is a xorshift64 generator, the lanes
+// are seeded differently. A message starts again from the seed in every
+// iteration, like the data that is read from memory. The send kernel
+// generates the sequence and the recv kernel checks it.
+
+#define PRBS_LANES (DATA_WIDTH / 64)
+
+typedef ap_uint<64> prbs_state_t[PRBS_LANES];
+
+static void prbs_init(unsigned int seed, prbs_state_t state)
+{
+prbs_init_lanes:
+    for (int l = 0; l < PRBS_LANES; l++) {
+#pragma HLS UNROLL
+        // never zero, which is the only invalid xorshift state
+        state[l] = ((ap_uint<64>)seed << 32) | (ap_uint<64>)(l + 1);
+    }
+}
+
+static ap_uint<DATA_WIDTH> prbs_next(prbs_state_t state)
+{
+    ap_uint<DATA_WIDTH> beat;
+prbs_next_lanes:
+    for (int l = 0; l < PRBS_LANES; l++) {
+#pragma HLS UNROLL
+        ap_uint<64> x = state[l];
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        state[l] = x;
+        beat.range(64 * l + 63, 64 * l) = x;
+    }
+    return beat;
+}
@@ -26,6 +26,8 @@
 
 #define STREAM_DEPTH 256
 
+#include "prbs.hpp"
+
 extern "C"
 {
     void recv_data(
@@ -53,19 +55,88 @@ extern "C"
         }
     }
 
+    // Compares the data with the PRBS of the sender instead of writing it
+    // to memory. The result is written into the first beat of data_output
+    // as 64 bit words: mismatching beats, bytes and bits and the position
+    // of the first mismatching beat, with the iteration in the upper and the
+    // beat in the lower 32 bits. The position is all ones without errors.
+    void check_data(
+        unsigned int iterations,
+        unsigned int chunks,
+        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
+        ap_uint<DATA_WIDTH> *data_output,
+        unsigned int prbs_seed
+    ) {
+        ap_uint<64> error_beats = 0;
+        ap_uint<64> error_bytes = 0;
+        ap_uint<64> error_bits = 0;
+        ap_uint<64> first_error = -1;
+        bool found = false;
+        prbs_state_t state;
+#pragma HLS ARRAY_PARTITION variable = state complete
+    check_iterations:
+        for (unsigned int n = 0; n < iterations; n++) {
+            prbs_init(prbs_seed, state);
+        check_chunks:
+            for (int i = 0; i < chunks; i++) {
+#pragma HLS PIPELINE II = 1
+                ap_uint<DATA_WIDTH> diff = data_stream.read() ^ prbs_next(state);
+                ap_uint<16> bytes = 0;
+                ap_uint<16> bits = 0;
+            check_bytes:
+                for (int b = 0; b < DATA_WIDTH_BYTES; b++) {
+#pragma HLS UNROLL
+                    bytes += (diff.range(8 * b + 7, 8 * b) != 0);
+                }
+            check_bits:
+                for (int b = 0; b < DATA_WIDTH; b++) {
+#pragma HLS UNROLL
+                    bits += diff[b];
+                }
+                if (bits != 0) {
+                    error_beats++;
+                    error_bytes += bytes;
+                    error_bits += bits;
+                    if (!found) {
+                        first_error = ((ap_uint<64>)n << 32) | (ap_uint<64>)i;
+                        found = true;
+                    }
+                }
+            }
+        }
+        ap_uint<DATA_WIDTH> result = 0;
+        result.range(63, 0) = error_beats;
+        result.range(127, 64) = error_bytes;
+        result.range(191, 128) = error_bits;
+        result.range(255, 192) = first_error;
+        data_output[0] = result;
+    }
+
+    // Iteration n is written into message slot n % slots, so up to slots
+    // iterations can be validated instead of only the last one. Every slot
+    // is written with consecutive addresses, so the writes are still bursts.
     void write_data(
         unsigned int iterations,
         unsigned int chunks,
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
-        ap_uint<DATA_WIDTH> *data_output
+        ap_uint<DATA_WIDTH> *data_output,
+        unsigned int prbs_seed,
+        unsigned int slots
     ) {
+        if (prbs_seed != 0) {
+            check_data(iterations, chunks, data_stream, data_output, prbs_seed);
+            return;
+        }
+        unsigned int slot = 0;
     write_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
+            ap_uint<DATA_WIDTH> *slot_output = data_output + (size_t)slot * chunks;
         write_chunks:
             for (int i = 0; i < chunks; i++) {
 #pragma HLS PIPELINE II = 1
-                data_output[i] = data_stream.read();
+                slot_output[i] = data_stream.read();
             }
+            slot = (slot + 1 < slots) ? slot + 1 : 0;
         }
     }
 
@@ -76,14 +147,16 @@ extern "C"
         unsigned int iterations,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>> &loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream,
+        unsigned int prbs_seed,
+        unsigned int slots
     ) {
 #pragma HLS dataflow
         int chunks = byte_size / DATA_WIDTH_BYTES;
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> data_stream;
 
         recv_data(iterations, chunks, data_input, data_stream, ack_mode, loopback_ack_stream, pair_ack_stream);
-        write_data(iterations, chunks, data_stream, data_output);
+        write_data(iterations, chunks, data_stream, data_output, prbs_seed, slots);
     }
 }
 
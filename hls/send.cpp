@@ -26,14 +26,43 @@
 
 #define STREAM_DEPTH 256
 
+#include "prbs.hpp"
+#include "latency.hpp"
+
 extern "C"
 {
+    // generates the PRBS of prbs_seed instead of reading the data from
+    // memory, so the throughput does not depend on the memory bandwidth
+    void generate_data(
+        unsigned int iterations,
+        unsigned int chunks,
+        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
+        unsigned int prbs_seed
+    ) {
+        prbs_state_t state;
+#pragma HLS ARRAY_PARTITION variable = state complete
+    generate_iterations:
+        for (unsigned int n = 0; n < iterations; n++) {
+            prbs_init(prbs_seed, state);
+        generate_chunks:
+            for (unsigned int i = 0; i < chunks; i++) {
+                #pragma HLS PIPELINE II = 1
+                data_stream.write(prbs_next(state));
+            }
+        }
+    }
+
     void read_data(
         unsigned int iterations,
         unsigned int chunks,
         ap_uint<DATA_WIDTH> *data_input,
-        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream
+        hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> &data_stream,
+        unsigned int prbs_seed
     ) {
+        if (prbs_seed != 0) {
+            generate_data(iterations, chunks, data_stream, prbs_seed);
+            return;
+        }
     read_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
         read_chunks:
@@ -44,6 +73,14 @@ extern "C"
         }
     }
 
+    // Latency of every message in cycles, from the cycle in which its first
+    // beat is written to data_output until the cycle in which the ack of
+    // the recv kernel that received the message is read. With loopback,
+    // this is the recv kernel of the same instance, in the pair topology
+    // the one of the other port of the same FPGA. Sending and waiting for
+    // the ack share one pipelined loop that counts its iterations, so the
+    // counter advances with every cycle between the two events. Neither
+    // part may block.
     void send_data(
         unsigned int iterations,
         unsigned int chunks,
@@ -52,27 +89,51 @@ extern "C"
         hls::stream<ap_axiu<DATA_WIDTH, 0, 0, 0>> &data_output,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>> &loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>> &pair_ack_stream,
+        ap_uint<64> *latency_output
     ) {
+        ap_uint<64> cycles = 0;
+        latency_stats_t stats;
+#pragma HLS ARRAY_PARTITION variable = stats complete
+        latency_init(stats);
     send_iterations:
         for (unsigned int n = 0; n < iterations; n++) {
+            ap_uint<64> start = cycles;
+            unsigned int i = 0;
+            // the ring topology has no acks
+            bool acked = (ack_mode >= 2);
         send_chunks:
-            for (unsigned int i = 0; i < chunks; i++) {
+            while (i < chunks || !acked) {
                 #pragma HLS PIPELINE II = 1
-                ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
-                temp.data = data_stream.read();
-                if (frame_size != 0) {
-                    temp.last = (((i + 1) % frame_size) == 0) || ((i + 1) == chunks);
-                    temp.keep = -1;
+                cycles++;
+                if (i < chunks) {
+                    if (!data_stream.empty() && !data_output.full()) {
+                        ap_axiu<DATA_WIDTH, 0, 0, 0> temp;
+                        temp.data = data_stream.read();
+                        if (frame_size != 0) {
+                            temp.last = (((i + 1) % frame_size) == 0) || ((i + 1) == chunks);
+                            temp.keep = -1;
+                        }
+                        data_output.write(temp);
+                        if (i == 0) {
+                            start = cycles;
+                        }
+                        i++;
+                    }
+                } else {
+                    ap_axiu<1, 0, 0, 0> ack;
+                    if (ack_mode == 0) {
+                        acked = loopback_ack_stream.read_nb(ack);
+                    } else {
+                        acked = pair_ack_stream.read_nb(ack);
+                    }
                 }
-                data_output.write(temp);
             }
-            if (ack_mode == 0) {
-                ap_axiu<1, 0, 0, 0> ack = loopback_ack_stream.read();
-            } else if (ack_mode == 1) {
-                ap_axiu<1, 0, 0, 0> ack = pair_ack_stream.read();
+            if (ack_mode < 2) {
+                latency_add(stats, cycles - start);
             }
         }
+        latency_write(stats, latency_output);
     }
 
     void send(
@@ -83,13 +144,16 @@ extern "C"
         unsigned int iterations,
         unsigned int ack_mode,
         hls::stream<ap_axiu<1, 0, 0, 0>>& loopback_ack_stream,
-        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream
+        hls::stream<ap_axiu<1, 0, 0, 0>>& pair_ack_stream,
+        unsigned int prbs_seed,
+        ap_uint<64> *latency_output
     ) {
+#pragma HLS INTERFACE m_axi port = latency_output bundle = gmem1
 #pragma HLS dataflow
         unsigned int chunks = byte_size / DATA_WIDTH_BYTES;
         hls::stream<ap_uint<DATA_WIDTH>, STREAM_DEPTH> data_stream;
 
-        read_data(iterations, chunks, data_input, data_stream);
-        send_data(iterations, chunks, frame_size, data_stream, data_output, ack_mode, loopback_ack_stream, pair_ack_stream);
+        read_data(iterations, chunks, data_input, data_stream, prbs_seed);
+        send_data(iterations, chunks, frame_size, data_stream, data_output, ack_mode, loopback_ack_stream, pair_ack_stream, latency_output);
     }
 }
@@ -27,6 +27,13 @@ public:
     bool semaphore;
     uint32_t timeout_ms;
     bool wait;
+    bool prbs;
+    uint32_t slots;
+    uint32_t emulator_port;
+    double kernel_clock_mhz;
+    bool pingpong;
+    // software emulation routes the data through emulated Aurora cores
+    bool emulated_links = false;
 
     std::vector<uint32_t> instances;
     std::vector<uint32_t> message_sizes;
@@ -52,6 +59,11 @@ public:
             ("s,semaphore", "Locks the results file. Needed for parallel evaluation", cxxopts::value<bool>()->default_value("false"))
             ("t,timeout_ms", "Timeout in ms", cxxopts::value<uint32_t>()->default_value("10000"))
             ("w,wait", "Wait for enter after loading bitstream. Needed for chipscope", cxxopts::value<bool>()->default_value("false"))
+            ("x,prbs", "Send pseudo-random data and validate it on the FPGA instead of the host", cxxopts::value<bool>()->default_value("false"))
+            ("k,slots", "Number of iterations that the recv kernel keeps in memory for validation", cxxopts::value<uint32_t>()->default_value("1"))
+            ("e,emulator_port", "Port of the emulated Aurora switch in software emulation", cxxopts::value<uint32_t>()->default_value("20000"))
+            ("g,pingpong", "Measure round trips with the pingpong kernels instead of sending data", cxxopts::value<bool>()->default_value("false"))
+            ("kernel_clock", "Clock of the send kernel in MHz. Converts the measured cycles into time", cxxopts::value<double>()->default_value("300"))
             ("h,help", "Print usage");
 
         auto result = options.parse(argc, argv);
@@ -79,17 +91,36 @@ public:
         semaphore = result["semaphore"].as<bool>();
         timeout_ms = result["timeout_ms"].as<uint32_t>();
         wait = result["wait"].as<bool>();
+        prbs = result["prbs"].as<bool>();
+        slots = result["slots"].as<uint32_t>();
+        emulator_port = result["emulator_port"].as<uint32_t>();
+        kernel_clock_mhz = result["kernel_clock"].as<double>();
+        pingpong = result["pingpong"].as<bool>();
+
+        if (pingpong && result.count("xclbin_path") == 0) {
+            xclbin_path = "aurora_flow_pingpong_hw.xclbin";
+        }
 
         if (xclbin_path == "") {
             std::cerr << "Error: no bitstream file passed" << std::endl;
             exit(EXIT_FAILURE);
         }
 
+        if (slots == 0) {
+            std::cerr << "Error: at least one slot is needed" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
         if (test_mode == 2 && num_instances == 2) {
             std::cout << "ring test mode is incompatible with single device selection" << std::endl;
             exit(EXIT_FAILURE);
         }
 
+        if (pingpong && test_mode > 2) {
+            std::cout << "pingpong needs the loopback, pair or ring topology" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
         if (nfc_test) {
             // add initial wait to timeout
             timeout_ms += 10000;
@@ -99,6 +130,12 @@ public:
 
     Configuration() {}
 
+    // seed of the data sent by an instance, 0 disables the check in recv
+    uint32_t prbs_seed(uint32_t instance)
+    {
+        return prbs ? instance + 1 : 0;
+    }
+
     void finish_setup(uint32_t fifo_width, bool has_framing, bool emulation) {
         if ((max_num_bytes % fifo_width ) != 0) {
             std::cout << "Error: number of bytes must be multiple of the fifo width " << fifo_width << std::endl;
@@ -106,8 +143,15 @@ public:
         }
 
         if (emulation) {
-            if (test_mode == 0) {
+            if (pingpong) {
+                // a loopback cable is emulated as a core that is its own remote
+                xclbin_path = "aurora_flow_pingpong_sw_emu.xclbin";
+                emulated_links = true;
+            } else if (test_mode == 0) {
                 xclbin_path = "aurora_flow_test_sw_emu_loopback.xclbin";
+            } else if (test_mode < 3) {
+                xclbin_path = "aurora_flow_test_sw_emu.xclbin";
+                emulated_links = true;
             } else {
                 std::cout << "Error: unsupported test mode for emulation" << std::endl;
                 exit(EXIT_FAILURE);
@@ -191,6 +235,14 @@ public:
         if (nfc_test) {
             std::cout << "Testing NFC interface" << std::endl;
         }
+        if (pingpong) {
+            std::cout << "Measuring round trips with the pingpong kernels" << std::endl;
+        }
+        if (prbs) {
+            std::cout << "Validating pseudo-random data on the FPGA" << std::endl;
+        } else if (slots > 1) {
+            std::cout << "Validating up to " << slots << " iterations" << std::endl;
+        }
         if (latency_test) {
             std::cout << "Measuring latency with the following configuration:" << std::endl;
             std::cout << std::setw(12) << "Repetition"
@@ -214,6 +266,9 @@ public:
         }
         std::cout << "Timeout: " << timeout_ms << " ms" << std::endl;
         std::cout << num_instances << " instances" << std::endl;
+        if (emulated_links) {
+            std::cout << "Emulated Aurora switch on port " << emulator_port << std::endl;
+        }
         if (semaphore) {
             std::cout << "Locking results.csv for parallel writing" << std::endl;
         }
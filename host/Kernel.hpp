@@ -7,6 +7,14 @@ public:
         snprintf(name, 100, "send:{send_%u}", instance);
         kernel = xrt::kernel(device, xclbin_uuid, name);
 
+        latency_bo = xrt::bo(device, CycleLatency::WORDS * sizeof(uint64_t), xrt::bo::flags::normal, kernel.group_id(9));
+
+        if (config.prbs) {
+            // the kernel generates the data, but the argument needs a buffer
+            data_bo = xrt::bo(device, 4096, xrt::bo::flags::normal, kernel.group_id(1));
+            return;
+        }
+
         data_bo = xrt::bo(device, config.max_num_bytes, xrt::bo::flags::normal, kernel.group_id(1));
 
         data_bo.write(data.data());
@@ -15,7 +23,8 @@ public:
 
     SendKernel() {}
 
-    void prepare_repetition(uint32_t repetition)
+    // prbs_seed selects the generated PRBS instead of the data in memory
+    void prepare_repetition(uint32_t repetition, uint32_t prbs_seed = 0)
     {
         run = xrt::run(kernel);
 
@@ -24,6 +33,8 @@ public:
         run.set_arg(3, config.frame_sizes[repetition]);
         run.set_arg(4, config.iterations_per_message[repetition]);
         run.set_arg(5, config.test_mode);
+        run.set_arg(8, prbs_seed);
+        run.set_arg(9, latency_bo);
     }
 
     void start()
@@ -36,9 +47,20 @@ public:
         return run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT;
     }
 
+    // reads the latency of the messages measured by the kernel, which is
+    // only available in the modes with ack
+    CycleLatency read_latency()
+    {
+        uint64_t words[CycleLatency::WORDS];
+        latency_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+        latency_bo.read(words);
+        return CycleLatency::from_words(words);
+    }
+
     std::vector<char> data;
 private:
     xrt::bo data_bo;
+    xrt::bo latency_bo;
     xrt::kernel kernel;
     xrt::run run;
     uint32_t instance;
@@ -55,14 +77,17 @@ public:
         snprintf(name, 100, "recv:{recv_%u}", instance);
         kernel = xrt::kernel(device, xclbin_uuid, name);
 
-        data_bo = xrt::bo(device, config.max_num_bytes, xrt::bo::flags::normal, kernel.group_id(1));
+        // one message per slot
+        size_t bytes = (size_t)config.max_num_bytes * config.slots;
+        data_bo = xrt::bo(device, bytes, xrt::bo::flags::normal, kernel.group_id(1));
 
-        data.resize(config.max_num_bytes);
+        data.resize(bytes);
     }
 
     RecvKernel() {}
 
-    void prepare_repetition(uint32_t repetition)
+    // prbs_seed is the seed of the sender, 0 writes the data back instead
+    void prepare_repetition(uint32_t repetition, uint32_t prbs_seed = 0)
     {
         run = xrt::run(kernel);
 
@@ -70,6 +95,8 @@ public:
         run.set_arg(2, config.message_sizes[repetition]);
         run.set_arg(3, config.iterations_per_message[repetition]);
         run.set_arg(4, config.test_mode);
+        run.set_arg(7, prbs_seed);
+        run.set_arg(8, config.slots);
     }
 
     void start()
@@ -88,15 +115,36 @@ public:
         data_bo.read(data.data());
     }
 
+    // reads the result of the PRBS check from the first beat of the
+    // output and returns the number of byte errors. The recv kernel
+    // counts the errors of all iterations of the repetition together
+    uint64_t check_prbs()
+    {
+        uint64_t result[4];
+        data_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE, sizeof(result), 0);
+        data_bo.read(result, sizeof(result), 0);
+        if (result[0] > 0) {
+            std::cout << result[0] << " beats with " << result[2] << " bit errors, first in iteration "
+                      << (result[3] >> 32) << " at beat " << (result[3] & 0xffffffff) << std::endl;
+        }
+        return result[1];
+    }
+
     uint32_t compare_data(char *ref, uint32_t repetition)
     {
         uint32_t err_num = 0;
-        for (uint32_t i = 0; i < config.message_sizes[repetition]; i++) {
-            if (data[i] != ref[i]) {
-                if (err_num < 16) {
-                    printf("recv[%d] = %02x, send[%d] = %02x\n", i, (uint8_t)data[i], i, (uint8_t)ref[i]);
+        uint32_t message_size = config.message_sizes[repetition];
+        // the slots of the last iterations, every slot holds one message
+        uint32_t slots = std::min(config.slots, config.iterations_per_message[repetition]);
+        for (uint32_t s = 0; s < slots; s++) {
+            size_t offset = (size_t)s * message_size;
+            for (uint32_t i = 0; i < message_size; i++) {
+                if (data[offset + i] != ref[i]) {
+                    if (err_num < 16) {
+                        printf("recv[%zu] = %02x, send[%d] = %02x\n", offset + i, (uint8_t)data[offset + i], i, (uint8_t)ref[i]);
+                    }
+                    err_num++;
                 }
-                err_num++;
             }
         }
         if (err_num > 16) {
@@ -115,3 +163,104 @@ private:
     Configuration config;
 };
 
+// one side of a link for measuring round trips, which either sends the
+// messages as ping or echoes them as pong
+class PingPongKernel
+{
+public:
+    PingPongKernel(uint32_t instance, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config) : instance(instance), config(config)
+    {
+        char name[100];
+        snprintf(name, 100, "pingpong:{pingpong_%u}", instance);
+        kernel = xrt::kernel(device, xclbin_uuid, name);
+
+        // the latency statistics and the number of beat errors
+        latency_bo = xrt::bo(device, (CycleLatency::WORDS + 1) * sizeof(uint64_t), xrt::bo::flags::normal, kernel.group_id(6));
+    }
+
+    PingPongKernel() {}
+
+    void prepare_repetition(uint32_t repetition, bool is_ping)
+    {
+        run = xrt::run(kernel);
+
+        run.set_arg(2, config.message_sizes[repetition]);
+        run.set_arg(3, config.frame_sizes[repetition]);
+        run.set_arg(4, config.iterations_per_message[repetition]);
+        run.set_arg(5, is_ping ? 1 : 0);
+        run.set_arg(6, latency_bo);
+    }
+
+    void start()
+    {
+        run.start();
+    }
+
+    bool timeout()
+    {
+        return run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT;
+    }
+
+    // reads the round trips measured by a ping and returns the number of
+    // beats of the replies with errors
+    uint32_t read_round_trips(CycleLatency &latency)
+    {
+        uint64_t words[CycleLatency::WORDS + 1];
+        latency_bo.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+        latency_bo.read(words);
+        latency = CycleLatency::from_words(words);
+        return words[CycleLatency::WORDS];
+    }
+
+private:
+    xrt::bo latency_bo;
+    xrt::kernel kernel;
+    xrt::run run;
+    uint32_t instance;
+    Configuration config;
+};
+
+// stand-in for the aurora_flow kernels in software emulation, which routes
+// the data of an instance through an emulated Aurora core and switch
+class EmulatorKernel
+{
+public:
+    EmulatorKernel(uint32_t instance, uint32_t remote, xrt::device &device, xrt::uuid &xclbin_uuid, Configuration &config) : instance(instance), remote(remote), config(config)
+    {
+        char name[100];
+        snprintf(name, 100, "aurora_flow_emu:{aurora_flow_emu_%u}", instance);
+        kernel = xrt::kernel(device, xclbin_uuid, name);
+    }
+
+    EmulatorKernel() {}
+
+    void prepare_repetition(uint32_t repetition)
+    {
+        run = xrt::run(kernel);
+
+        // the kernel derives the number of beats from the message size
+        // like the send and recv kernels
+        run.set_arg(2, instance);
+        run.set_arg(3, remote);
+        run.set_arg(4, config.message_sizes[repetition]);
+        run.set_arg(5, config.iterations_per_message[repetition]);
+        run.set_arg(6, config.emulator_port);
+    }
+
+    void start()
+    {
+        run.start();
+    }
+
+    bool timeout()
+    {
+        return run.wait(std::chrono::milliseconds(config.timeout_ms)) == ERT_CMD_STATE_TIMEOUT;
+    }
+
+private:
+    xrt::kernel kernel;
+    xrt::run run;
+    uint32_t instance;
+    uint32_t remote;
+    Configuration config;
+};
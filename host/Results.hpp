@@ -1,3 +1,63 @@
+// latency of the messages of a repetition in cycles, measured by the send
+// kernel from the first beat of a message until the ack of the recv kernel
+struct CycleLatency
+{
+    // count, min, max and sum, followed by the histogram
+    static const uint32_t HEADER = 4;
+    static const uint32_t BUCKETS = 32;
+    static const uint32_t WORDS = HEADER + BUCKETS;
+
+    uint64_t count = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    uint64_t sum = 0;
+    // bucket b counts the latencies from 2^b to 2^(b+1)-1 cycles
+    std::vector<uint64_t> histogram = std::vector<uint64_t>(BUCKETS);
+
+    // statistics in the layout of the kernels
+    static CycleLatency from_words(const uint64_t *words)
+    {
+        CycleLatency latency;
+        latency.count = words[0];
+        latency.min = words[1];
+        latency.max = words[2];
+        latency.sum = words[3];
+        latency.histogram.assign(words + HEADER, words + WORDS);
+        return latency;
+    }
+
+    void merge(const CycleLatency &other)
+    {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0 || other.min < min) {
+            min = other.min;
+        }
+        if (other.max > max) {
+            max = other.max;
+        }
+        count += other.count;
+        sum += other.sum;
+        for (uint32_t b = 0; b < BUCKETS; b++) {
+            histogram[b] += other.histogram[b];
+        }
+    }
+
+    // upper bound of the given fraction of the latencies
+    uint64_t percentile(double fraction)
+    {
+        uint64_t seen = 0;
+        for (uint32_t b = 0; b < BUCKETS; b++) {
+            seen += histogram[b];
+            if (seen >= fraction * count) {
+                return std::min(max, ((uint64_t)1 << (b + 1)) - 1);
+            }
+        }
+        return max;
+    }
+};
+
 class Results
 {
 public:
@@ -8,7 +68,7 @@ public:
     std::vector<uint32_t> aurora_config;
     std::vector<std::vector<double>> transmission_times;
     std::vector<std::vector<uint32_t>> failed_transmissions;
-    std::vector<std::vector<uint32_t>> errors;
+    std::vector<std::vector<uint64_t>> errors;
     std::vector<std::vector<uint32_t>> fifo_rx_overflow_count;
     std::vector<std::vector<uint32_t>> fifo_tx_overflow_count;
     std::vector<std::vector<uint32_t>> nfc_full_trigger_count;
@@ -31,11 +91,19 @@ public:
     std::vector<std::vector<uint32_t>> channel_down_count;
     std::vector<std::vector<uint32_t>> frames_received;
     std::vector<std::vector<uint32_t>> frames_with_errors;
+    std::vector<std::vector<CycleLatency>> cycle_latencies;
 
     bool emulation;
+    // counters can be read from hardware cores and from emulated cores
+    // that provide a register file
+    bool counters;
 
     Results(Configuration &config, std::vector<Aurora> auroras, bool emulation, std::vector<std::string> device_bdfs) : config(config), auroras(auroras), device_bdfs(device_bdfs), emulation(emulation)
     {
+        counters = !emulation || auroras.size() >= config.num_instances;
+        for (uint32_t i = 0; counters && i < config.num_instances; i++) {
+            counters = auroras[i].has_registers();
+        }
         transmission_times.resize(config.num_instances);
         failed_transmissions.resize(config.num_instances);
 
@@ -47,6 +115,7 @@ public:
         errors.resize(config.num_instances);
         frames_received.resize(config.num_instances);
         frames_with_errors.resize(config.num_instances);
+        cycle_latencies.resize(config.num_instances);
         tx_count.resize(config.num_instances);
         rx_count.resize(config.num_instances);
         
@@ -78,6 +147,7 @@ public:
             errors[i].resize(config.repetitions);
             frames_received[i].resize(config.repetitions);
             frames_with_errors[i].resize(config.repetitions);
+            cycle_latencies[i].resize(config.repetitions);
             tx_count[i].resize(config.repetitions);
             rx_count[i].resize(config.repetitions);
             
@@ -98,7 +168,7 @@ public:
 
             channel_down_count[i].resize(config.repetitions);
        }
-       if (!emulation) {
+       if (counters) {
             aurora_config.resize(config.num_instances); 
             for (uint32_t i = 0; i < config.num_instances; i++) {
                 aurora_config[i] = auroras[i].get_configuration();
@@ -109,7 +179,7 @@ public:
 
     void update_counter(uint32_t instance, uint32_t repetition)
     {
-        if (!emulation) {
+        if (counters) {
             fifo_rx_overflow_count[instance][repetition] = auroras[instance].get_fifo_rx_overflow_count();
             fifo_tx_overflow_count[instance][repetition] = auroras[instance].get_fifo_tx_overflow_count();
             nfc_full_trigger_count[instance][repetition] = auroras[instance].get_nfc_full_trigger_count();
@@ -160,9 +230,9 @@ public:
         return count;
     }
 
-    uint32_t total_byte_errors()
+    uint64_t total_byte_errors()
     {
-        uint32_t count = 0;
+        uint64_t count = 0;
         for (uint32_t i = 0; i < config.num_instances; i++) {
             for (uint32_t r = 0; r < config.repetitions; r++) {
                 count += errors[i][r];
@@ -216,7 +286,7 @@ public:
     void print_results()
     {
         std::cout << std::setw(36) << "Config" << std::setw(25) << "|";
-        if (!emulation) {
+        if (counters) {
             std::cout << std::setw(24) << "Latency (s)" << std::setw(12) << "|"
                       << std::setw(27) << "Throughput (Gbit/s)" << std::setw(9) << "|"
                       << std::setw(27) << "Counts per iteration" << std::setw(9) << "|"
@@ -228,7 +298,7 @@ public:
                   << std::setw(12) << "Iterations"
                   << std::setw(12) << "Frame Size"
                   << std::setw(12) << "Bytes";
-        if (!emulation) {
+        if (counters) {
             std::cout << "|" << std::setw(11) << "Min."
                       << std::setw(12) << "Avg."
                       << std::setw(12) << "Max."
@@ -242,7 +312,7 @@ public:
                       << std::setw(12) << "Latency"
                       << std::setw(12) << "TX Stalls";
         }
-        std::cout << std::endl << std::setw(emulation ? 60 : 204) << std::setfill('-') << "-"
+        std::cout << std::endl << std::setw(counters ? 204 : 60) << std::setfill('-') << "-"
                   << std::endl << std::setfill(' ');
         for (uint32_t r = 0; r < config.repetitions; r++) {
             double latency_min = std::numeric_limits<double>::infinity();
@@ -256,7 +326,7 @@ public:
             uint64_t nfc_full_triggered_sum = 0;
             uint64_t nfc_max_latency = 0;
             uint64_t fifo_tx_stalls_sum = 0;
-            if (!emulation) {
+            if (counters) {
                 for (uint32_t i = 0; i < config.num_instances; i++) {
                     double latency = transmission_times[i][r] / config.iterations_per_message[r];
                     latency_sum += latency;
@@ -283,7 +353,7 @@ public:
                       << std::setw(12) << config.iterations_per_message[r]
                       << std::setw(12) << config.frame_sizes[r]
                       << std::setw(12) << config.message_sizes[r];
-            if (!emulation) {
+            if (counters) {
                 std::cout << std::setw(12) << latency_min
                           << std::setw(12) << latency_avg
                           << std::setw(12) << latency_max
@@ -301,13 +371,58 @@ public:
         }
     }
 
+    // the latency measured on the FPGA, without the overhead of starting
+    // the kernels. The send kernel counts the cycles from writing the first
+    // beat of a message until it reads the ack of the recv kernel that
+    // received the message, which is on the same FPGA in the loopback and
+    // the pair topology. A message of n beats whose ack is already waiting
+    // takes n cycles. The ping counts the cycles from its first beat out
+    // until the last beat of the reply is read. Cycles in software
+    // emulation are no time
+    void print_cycle_latency()
+    {
+        if (emulation || (config.test_mode > 1 && !config.pingpong)) {
+            return;
+        }
+        const double ns_per_cycle = 1000.0 / config.kernel_clock_mhz;
+        std::cout << std::endl
+                  << std::setw(36) << (config.pingpong ? "Round trip latency (ns)" : "On-chip latency (ns)") << std::endl
+                  << std::setw(12) << "Repetition"
+                  << std::setw(12) << "Bytes"
+                  << std::setw(12) << "Messages"
+                  << std::setw(12) << "Min."
+                  << std::setw(12) << "Avg."
+                  << std::setw(12) << "Max."
+                  << std::setw(12) << "50% <="
+                  << std::setw(12) << "99% <="
+                  << std::endl << std::setw(96) << std::setfill('-') << "-"
+                  << std::endl << std::setfill(' ');
+        for (uint32_t r = 0; r < config.repetitions; r++) {
+            CycleLatency latency;
+            for (uint32_t i = 0; i < config.num_instances; i++) {
+                latency.merge(cycle_latencies[i][r]);
+            }
+            std::cout << std::setw(12) << r
+                      << std::setw(12) << config.message_sizes[r]
+                      << std::setw(12) << latency.count;
+            if (latency.count > 0) {
+                std::cout << std::setw(12) << latency.min * ns_per_cycle
+                          << std::setw(12) << (double)latency.sum / latency.count * ns_per_cycle
+                          << std::setw(12) << latency.max * ns_per_cycle
+                          << std::setw(12) << latency.percentile(0.5) * ns_per_cycle
+                          << std::setw(12) << latency.percentile(0.99) * ns_per_cycle;
+            }
+            std::cout << std::endl;
+        }
+    }
+
     void print_errors()
     {
         std::cout << std::endl 
                   << std::setw(12) << "Repetition"
                   << std::setw(12) << "Failed"
                   << std::setw(12) << "Bytes";
-        if (!emulation) {
+        if (counters) {
             std::cout << std::setw(12) << "Frames"
                       << std::setw(12) << "FIFO RX"
                       << std::setw(12) << "NFC"
@@ -325,12 +440,12 @@ public:
                       << std::setw(12) << "Soft err"
                       << std::setw(12) << "Channel";
         }
-        std::cout << std::endl << std::setw(emulation ? 36 : 240) << std::setfill('-') << "-"
+        std::cout << std::endl << std::setw(counters ? 240 : 36) << std::setfill('-') << "-"
                   << std::endl << std::setfill(' ');
 
         for (uint32_t r = 0; r < config.repetitions; r++) {
             uint32_t failed_transmissions_sum = 0;
-            uint32_t byte_errors_sum = 0;
+            uint64_t byte_errors_sum = 0;
             uint32_t frame_errors_sum = 0;
             uint32_t fifo_rx_errors_sum = 0;
             uint32_t nfc_full_trigger_sum = 0;
@@ -353,7 +468,7 @@ public:
                     failed_transmissions_sum++;
                 }
                 byte_errors_sum += errors[i][r];
-                if (!emulation) {
+                if (counters) {
                     frame_errors_sum += frames_with_errors[i][r];
                     fifo_rx_errors_sum += fifo_rx_overflow_count[i][r];
                     nfc_full_trigger_sum += nfc_full_trigger_count[i][r];
@@ -376,7 +491,7 @@ public:
             std::cout << std::setw(12) << r
                       << std::setw(12) << failed_transmissions_sum
                       << std::setw(12) << byte_errors_sum;
-            if (!emulation) {
+            if (counters) {
                 std::cout << std::setw(12) << frame_errors_sum
                           << std::setw(12) << fifo_rx_errors_sum
                           << std::setw(12) << nfc_full_trigger_sum - nfc_empty_trigger_sum
@@ -421,7 +536,8 @@ public:
 
     void write()
     {
-        if (emulation) {
+        // the csv only has columns for the transfers of send and recv
+        if (emulation || config.pingpong) {
             return;
         }
         char* hostname;
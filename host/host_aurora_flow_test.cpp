@@ -79,6 +79,88 @@ std::string bdf_map(uint32_t device_id, bool emulation)
     }
 }
 
+// Every link has a ping on the instance with the lower number and a pong
+// on the other side. With a loopback cable, the ping is its own partner.
+void run_pingpong(Configuration &config, std::vector<xrt::device> &devices, std::vector<xrt::uuid> &xclbin_uuids, std::vector<EmulatorKernel> &emulator_kernels, Results &results, bool emulation)
+{
+    std::vector<PingPongKernel> kernels(config.num_instances);
+    for (uint32_t i = 0; i < config.num_instances; i++) {
+        kernels[i] = PingPongKernel(config.instances[i], devices[emulation ? 0 : i / 2], xclbin_uuids[emulation ? 0 : i / 2], config);
+    }
+
+    for (uint32_t r = 0; r < config.repetitions; r++) {
+        std::cout << "Repetition " << r << " with " << config.message_sizes[r] << " bytes" << std::endl;
+        for (EmulatorKernel &emulator : emulator_kernels) {
+            emulator.prepare_repetition(r);
+            emulator.start();
+        }
+        for (uint32_t i = 0; i < config.num_instances; i++) {
+            uint32_t i_pong = mode_map(i, config.num_instances, config.test_mode);
+            if (i_pong < i) {
+                continue;
+            }
+            PingPongKernel &ping = kernels[i];
+            PingPongKernel &pong = kernels[i_pong];
+            std::cout << "Round trips from " << i << " to " << i_pong << std::endl;
+            try {
+                ping.prepare_repetition(r, true);
+                if (i_pong != i) {
+                    pong.prepare_repetition(r, false);
+                    pong.start();
+                }
+
+                double start_time = get_wtime();
+
+                ping.start();
+
+                if (ping.timeout()) {
+                    std::cout << "Ping timeout" << std::endl;
+                    results.failed_transmissions[i][r] = 1;
+                } else {
+                    results.failed_transmissions[i][r] = 0;
+                }
+
+                if (i_pong != i && pong.timeout()) {
+                    std::cout << "Pong timeout" << std::endl;
+                    results.failed_transmissions[i][r] = 2;
+                }
+
+                double end_time = get_wtime();
+
+                results.transmission_times[i][r] = end_time - start_time;
+
+                if (results.failed_transmissions[i][r] == 0) {
+                    results.errors[i][r] = ping.read_round_trips(results.cycle_latencies[i][r]);
+                    if (results.errors[i][r]) {
+                        std::cout << results.errors[i][r] << " beats with errors" << std::endl;
+                    }
+                }
+            } catch (const std::runtime_error &e) {
+                std::cout << "caught runtime error: " << e.what() << std::endl;
+                results.failed_transmissions[i][r] = 3;
+            } catch (const std::exception &e) {
+                std::cout << "caught unexpected error: " << e.what() << std::endl;
+                results.failed_transmissions[i][r] = 4;
+            } catch (...) {
+                std::cout << "caught non-std::logic_error " << std::endl;
+                results.failed_transmissions[i][r] = 5;
+            }
+            results.update_counter(i, r);
+            if (i_pong != i) {
+                results.update_counter(i_pong, r);
+            }
+        }
+        for (uint32_t i = 0; i < emulator_kernels.size(); i++) {
+            if (emulator_kernels[i].timeout()) {
+                std::cout << "Emulator timeout on instance " << i << std::endl;
+                if (results.failed_transmissions[i][r] == 0) {
+                    results.failed_transmissions[i][r] = 1;
+                }
+            }
+        }
+    }
+}
+
 int main(int argc, char *argv[])
 {
     Configuration config(argc, argv);
@@ -145,7 +227,29 @@ int main(int argc, char *argv[])
                   << " and input width of " << auroras[0].fifo_width << " bytes" << std::endl;
     }
 
-    std::vector<std::vector<char>> data = generate_data(config.max_num_bytes, config.num_instances);
+    // the send kernels generate the data themselves in PRBS mode, the
+    // pingpong kernels as well
+    std::vector<std::vector<char>> data(config.num_instances);
+    if (!config.prbs && !config.pingpong) {
+        data = generate_data(config.max_num_bytes, config.num_instances);
+    }
+
+    // the emulated aurora cores of all instances forward data in both
+    // directions for the whole repetition
+    std::vector<EmulatorKernel> emulator_kernels(config.emulated_links ? config.num_instances : 0);
+    for (uint32_t i = 0; i < emulator_kernels.size(); i++) {
+        emulator_kernels[i] = EmulatorKernel(config.instances[i], config.instances[mode_map(i, config.num_instances, config.test_mode)], devices[0], xclbin_uuids[0], config);
+    }
+
+    Results results(config, auroras, emulation, device_bdfs);
+
+    if (config.pingpong) {
+        // only the pings have results, so the table of the transfers is skipped
+        run_pingpong(config, devices, xclbin_uuids, emulator_kernels, results, emulation);
+        results.print_cycle_latency();
+        results.print_errors();
+        return results.has_errors();
+    }
 
     // create kernel objects
     std::vector<SendKernel> send_kernels(config.num_instances);
@@ -155,10 +259,12 @@ int main(int argc, char *argv[])
         recv_kernels[i] = RecvKernel(config.instances[i], devices[emulation ? 0 : i / 2], xclbin_uuids[emulation ? 0 : i / 2], config);
     }
 
-    Results results(config, auroras, emulation, device_bdfs);
-
     for (uint32_t r = 0; r < config.repetitions; r++) {
         std::cout << "Repetition " << r << " with " << config.message_sizes[r] << " bytes" << std::endl;
+        for (EmulatorKernel &emulator : emulator_kernels) {
+            emulator.prepare_repetition(r);
+            emulator.start();
+        }
         for (uint32_t i = 0; i < config.num_instances; i++) {
             uint32_t i_recv = mode_map(i, config.num_instances, config.test_mode);
             SendKernel &send = send_kernels[i];
@@ -166,8 +272,8 @@ int main(int argc, char *argv[])
             Aurora &recv_aurora = auroras[i_recv];
             std::cout << "Sending from " << i << " to " << i_recv << std::endl;
             try {
-                send.prepare_repetition(r);
-                recv.prepare_repetition(r);
+                send.prepare_repetition(r, config.prbs_seed(i));
+                recv.prepare_repetition(r, config.prbs_seed(i));
                 if (config.nfc_test) {
                     std::cout << "Testing NFC: waiting 3 seconds before starting the recv kernel" << std::endl;
                     if (!emulation) {
@@ -210,9 +316,17 @@ int main(int argc, char *argv[])
 
                 results.transmission_times[i][r] = end_time - start_time;
 
-                recv.write_back();
+                if (results.failed_transmissions[i][r] == 0 && config.test_mode < 2) {
+                    results.cycle_latencies[i][r] = send.read_latency();
+                }
 
-                if (config.test_mode < 3) {
+                if (config.prbs) {
+                    results.errors[i][r] = recv.check_prbs();
+                    if (results.errors[i][r]) {
+                        std::cout << results.errors[i][r] << " byte errors" << std::endl;
+                    }
+                } else if (config.test_mode < 3) {
+                    recv.write_back();
                     results.errors[i][r] = recv.compare_data(data[i].data(), r);
                     if (results.errors[i][r]) {
                         std::cout << results.errors[i][r] << " byte errors" << std::endl;
@@ -238,6 +352,14 @@ int main(int argc, char *argv[])
                 }
             }
         }
+        for (uint32_t i = 0; i < emulator_kernels.size(); i++) {
+            if (emulator_kernels[i].timeout()) {
+                std::cout << "Emulator timeout on instance " << i << std::endl;
+                if (results.failed_transmissions[i][r] == 0) {
+                    results.failed_transmissions[i][r] = 1;
+                }
+            }
+        }
     }
 
     uint32_t total_failed_transmissions = results.total_failed_transmissions();
@@ -248,7 +370,7 @@ int main(int argc, char *argv[])
         if (config.nfc_test) {
             std::cout << "NFC test passed" << std::endl;
         } else {
-            uint32_t total_byte_errors = results.total_byte_errors();
+            uint64_t total_byte_errors = results.total_byte_errors();
             if (total_byte_errors) {
                 std::cout << total_byte_errors << " bytes with errors in total" << std::endl;
             }
@@ -261,6 +383,7 @@ int main(int argc, char *argv[])
         }
     }
     results.print_results();
+    results.print_cycle_latency();
     results.print_errors();
     results.write();
 